@@ -0,0 +1,107 @@
+#!/usr/bin/env bash
+
+# Mede o tempo de cada fase do pcv sequencial e do paralelo (opção -t), com
+# sementes fixas, variando N, o número de processos e o número de threads.
+# Cada execução paralela é comparada à sequencial com o mesmo N e a mesma
+# semente, e o resultado é impresso em CSV ou JSON.
+#
+# Uso: ./benchmark.sh [-n "N..."] [-p "PROCESSOS..."] [-t "THREADS..."]
+#                     [-s "SEMENTES..."] [-o "OPÇÕES"] [-m "OPÇÕES DO MPIRUN"]
+#                     [-f csv|json]
+
+set -e
+
+SIZES="8 10 12"
+PROCESSES="1 2 4"
+THREADS="1 2 4"
+SEEDS="1 2 3"
+OPTIONS="-b"
+MPIRUN_OPTIONS=""
+FORMAT="csv"
+
+while getopts "n:p:t:s:o:m:f:" opt; do
+    case $opt in
+        n) SIZES=$OPTARG ;;
+        p) PROCESSES=$OPTARG ;;
+        t) THREADS=$OPTARG ;;
+        s) SEEDS=$OPTARG ;;
+        o) OPTIONS=$OPTARG ;;
+        m) MPIRUN_OPTIONS=$OPTARG ;;
+        f) FORMAT=$OPTARG ;;
+        *) exit 1 ;;
+    esac
+done
+
+if [ "$FORMAT" != "csv" ] && [ "$FORMAT" != "json" ]; then
+    echo "Formato desconhecido: $FORMAT" >&2
+    exit 1
+fi
+
+# As duas versões são compiladas no mesmo binário, então são renomeadas
+make -s seq > /dev/null && mv pcv pcv-bench-seq
+make -s par > /dev/null && mv pcv pcv-bench-par
+trap 'rm -f pcv-bench-seq pcv-bench-par' EXIT
+
+COLUMNS="generation,search,gather,merge,output,total"
+
+# Lê a linha JSON de -t e imprime os tempos na ordem de COLUMNS
+read_times() {
+    grep '^{"n"' | tail -n 1 | tr -d '{}" ' | tr ',' '\n' |
+        awk -F: -v columns="$COLUMNS" '
+        { value[$1] = $2 }
+        END {
+            count = split(columns, names, ",")
+            for (i = 1; i <= count; i++) {
+                printf "%s%s", value[names[i]], (i < count) ? "," : "\n"
+            }
+        }'
+}
+
+# Imprime uma linha de resultado, com o speedup e a eficiência em relação ao
+# tempo total sequencial
+print_row() {
+    echo "$1,$2,$3,$4,$5,$6" | awk -F, -v base="$7" '{
+        speedup = ($NF > 0) ? base / $NF : 0
+        printf "%s,%.4f,%.4f\n", $0, speedup, speedup / ($4 * $5)
+    }'
+}
+
+ROWS=""
+for n in $SIZES; do
+    for seed in $SEEDS; do
+        times=$(./pcv-bench-seq "$n" -r "$seed" -t $OPTIONS 2>&1 > /dev/null |
+            read_times)
+        base=${times##*,}
+        ROWS+=$(print_row seq "$n" "$seed" 1 1 "$times" "$base")$'\n'
+
+        for p in $PROCESSES; do
+            for t in $THREADS; do
+                # $MPIRUN_OPTIONS e $OPTIONS podem ter várias opções
+                times=$(mpirun -np "$p" --bind-to none -x OMP_NUM_THREADS="$t" \
+                    $MPIRUN_OPTIONS ./pcv-bench-par "$n" -r "$seed" -t \
+                    $OPTIONS 2>&1 > /dev/null | read_times)
+                ROWS+=$(print_row par "$n" "$seed" "$p" "$t" "$times" \
+                    "$base")$'\n'
+            done
+        done
+    done
+done
+
+HEADER="engine,n,seed,ranks,threads,$COLUMNS,speedup,efficiency"
+if [ "$FORMAT" = "csv" ]; then
+    echo "$HEADER"
+    printf "%s" "$ROWS"
+else
+    printf "%s" "$ROWS" | awk -F, -v header="$HEADER" '
+        BEGIN { count = split(header, names, ","); print "[" }
+        {
+            if (NR > 1) print ","
+            printf "  {"
+            for (i = 1; i <= count; i++) {
+                value = (i == 1) ? "\"" $i "\"" : $i
+                printf "\"%s\": %s%s", names[i], value, (i < count) ? ", " : ""
+            }
+            printf "}"
+        }
+        END { print "\n]" }'
+fi
@@ -12,10 +12,19 @@
 
 #include <mpi.h>
 #include <omp.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 // Passar argumento no momento de compilação
 #ifdef THREADS_N
@@ -28,22 +37,143 @@ int THREADS = 0;
 ****** Constantes e definições de tipos ********
 */
 
+#ifndef MAX_COST // Pode ser redefinido na compilação, com -DMAX_COST=...
 #define MAX_COST                                                               \
   50 // Peso máximo de uma aresta. Quando uma aresta tem esse peso, o custo
      // dessa aresta é considerado infinito (aresta inexistente).
-#define MAX_GRAPH_SIZE 15                  // Tamanho maximo do grafo
-#define MAX_PATH_SIZE (MAX_GRAPH_SIZE + 1) // Tamanho máximo de um caminho
+#endif
+#define HELD_KARP_MAX_SIZE 32 // Tamanho máximo do grafo no Held-Karp, cujos
+                              // subconjuntos são máscaras de 32 bits
+#define SET_WORD_BITS 64 // Número de nós em cada palavra de um conjunto
+// O número de palavras de um conjunto de n nós
+#define SET_WORDS(n) (((n) + SET_WORD_BITS - 1) / SET_WORD_BITS)
+#define SPECIALIZED_MAX_SIZE 16 // Maior grafo com um kernel de busca próprio
 #define STARTING_NODE 0
-#define COST_NOT_COMPUTED 0
+#define COST_NOT_COMPUTED -1
 #define COST_INFINITE __INT_MAX__
-#define PATH_LIST_SIZE 32
+#define PATH_LIST_SIZE 4 // Capacidade inicial de uma path list
 #define PATH_LIST_EMPTY -1
+#define PATH_LIST_UNLIMITED -1 // Path list que guarda todos os caminhos
+#define STREAM_CHUNK_SIZE 4096 // Tamanho dos blocos copiados entre arquivos
+#define SOLVER_DFS 0       // Busca em profundidade
+#define SOLVER_HELD_KARP 1 // Programação dinâmica de Held-Karp
+#define OUTPUT_ALL 0       // Imprime todos os caminhos de menor custo
+#define OUTPUT_COUNT 1     // Imprime só o menor custo e o número de caminhos
+#define OUTPUT_FIRST 2     // Imprime só um dos caminhos de menor custo
+#define OUTPUT_STREAM 3    // Escreve os caminhos em um arquivo ao encontrá-los
+#define CACHE_LINE_SIZE 64 // Tamanho de uma linha de cache, em bytes
+#define ARENA_CHUNK_SIZE (64 * 1024) // Tamanho mínimo de um bloco de uma arena
+#define ARENA_SMALL_CLASSES 64       // Classes de tamanho de 16 em 16 bytes
+#define ARENA_SIZE_CLASSES 96        // Total de classes de tamanho
+#define TSPLIB_MAX_LINE 256 // Tamanho máximo de uma linha de um arquivo TSPLIB
+#define TSPLIB_MAX_VALUE 31 // Tamanho máximo de um valor de palavra-chave
+#define TSPLIB_PI 3.141592  // Valor de pi da especificação do TSPLIB
+#define TSPLIB_EARTH_RADIUS 6378.388 // Raio da Terra, em km, no tipo GEO
+#define BINARY_MATRIX_MAGIC "PCVMATRX" // Início de uma matriz binária
+#define BINARY_MATRIX_MAGIC_SIZE 8     // Tamanho de BINARY_MATRIX_MAGIC
+#define BINARY_MATRIX_HEADER_SIZE 64   // Tamanho do cabeçalho da matriz binária
+#define BATCH_MAX_LINE 1024 // Tamanho máximo de uma linha de uma lista
+#define PHASE_GENERATION 0 // Geração ou leitura e distribuição da matriz
+#define PHASE_SEARCH 1     // Busca dos caminhos de menor custo
+#define PHASE_GATHER 2     // Coleta das respostas dos processos
+#define PHASE_MERGE 3      // Junção das respostas das threads
+#define PHASE_OUTPUT 4     // Impressão da resposta
+#define PHASES 5           // Número de fases medidas
+#define SEED_FROM_TIME -1  // Semente gerada a partir do horário
+#define COUNTER_EXPANDED 0   // Nós expandidos (caminhos parciais estendidos)
+#define COUNTER_LEAVES 1     // Caminhos com todos os nós alcançados
+#define COUNTER_INFEASIBLE 2 // Ramos descartados por arestas inexistentes
+#define COUNTER_PRUNED 3     // Ramos podados pelo branch and bound
+#define COUNTER_TIES 4       // Caminhos com o custo do melhor já encontrado
+#define COUNTERS 5           // Número de contadores da busca
+#define BOUND_MIN_REMAINING 6 // Nós restantes abaixo dos quais o limitante
+                              // inferior não é calculado
+#define BOUND_ITERATIONS 3    // Iterações do subgradiente em cada limitante
+#define BOUND_STEP 2.0        // Fator do passo do subgradiente
+#define BOUND_EPSILON 1e-6    // Folga dos erros de arredondamento na poda
+#define LEAF_LEVELS 4         // Níveis finais avaliados de uma só vez
+#define LEAF_PERMUTATIONS 24  // Ordens dos nós dos níveis finais (4!)
+#define LEAF_MISSING (1 << 26) // Custo de uma aresta inexistente nas folhas
+// O cabeçalho da tabela impressa por print_counters_row
+#define COUNTERS_HEADER                                                        \
+  "  rank  thread   expandidos       folhas    inviáveis        podas      "   \
+  "empates"
+
+// Incrementa um contador da busca, se eles foram habilitados na compilação
+#ifdef SEARCH_STATS
+#define COUNT_SEARCH(s, counter) ((s)->counters[counter]++)
+#else
+#define COUNT_SEARCH(s, counter) ((void)0)
+#endif
 #define MANAGER_PROCESS_RANK 0
+#define MAP_WORD_BITS 64 // Subconjuntos em cada palavra de um mapa de bits
+#define DEFAULT_SPLIT_DEPTH 2 // Profundidade padrão dos prefixos das tarefas
+#define MAX_TASKS (1 << 22)   // Número máximo de tarefas na fila
+#define NO_TASK -1
+#define NO_MATRIX -1 // Tamanho enviado aos workers se a matriz não foi lida
+#define BATCH_SIZE 16 // Capacidade inicial das respostas de um lote
+#define TAG_TASK_REQUEST 1 // Pedido de uma tarefa, de um worker à manager
+#define TAG_TASK 2         // Resposta a um pedido de tarefa
+#define TAG_STREAM 3       // Um bloco de um arquivo de caminhos
+#define TAG_RESULT 4       // Parte da resposta de um processo
+#define TASK_SPLIT_LEVELS 2  // Níveis de cada tarefa divididos com OpenMP
+#define TASK_MIN_REMAINING 6 // Nós restantes abaixo dos quais não se divide
+#define CHECKPOINT_MAGIC "PCVCHKPT" // Início de um arquivo de checkpoint
+#define CHECKPOINT_MAGIC_SIZE 8     // Tamanho de CHECKPOINT_MAGIC
+#define CHECKPOINT_RECORD_FIELDS 4  // Campos do cabeçalho de cada registro
+#define FNV_OFFSET_BASIS 14695981039346656037ull // Valor inicial do FNV-1a
+#define FNV_PRIME 1099511628211ull                // Multiplicador do FNV-1a
+#define CHECKPOINT_SYNC_INTERVAL 30.0 // Segundos entre duas gravações dos
+                                      // checkpoints em disco
+
+/* Os níveis finais só são avaliados de uma só vez se as somas de
+LEAF_LEVELS + 1 arestas, inexistentes ou não, cabem em um int */
+#if MAX_COST <= USHRT_MAX
+#define LEAF_SEARCH 1
+#else
+#define LEAF_SEARCH 0
+#endif
 
-typedef struct _path {      // Um caminho
-  int nodes[MAX_PATH_SIZE]; // Os nós no caminho
-  int cost;                 // Custo do caminho até então
-  int size;                 // Número de nós no caminho
+// O peso de uma aresta, no menor tipo que comporta MAX_COST
+#if MAX_COST <= UCHAR_MAX
+typedef unsigned char weight;
+#define MPI_WEIGHT MPI_UNSIGNED_CHAR
+#elif MAX_COST <= USHRT_MAX
+typedef unsigned short weight;
+#define MPI_WEIGHT MPI_UNSIGNED_SHORT
+#else
+typedef int weight;
+#define MPI_WEIGHT MPI_INT
+#endif
+
+typedef struct _cost_matrix { // Uma matriz de custos contígua, linha a linha
+  weight *weights;            // Os pesos das arestas
+  int n;                      // O número de linhas e colunas
+  int stride;                 // A distância entre o início de duas linhas
+  void *mapping;       // O arquivo mapeado em memória que contém os pesos,
+                       // ou NULL se os pesos foram alocados
+  size_t mapping_size; // O tamanho do mapeamento, em bytes
+} cost_matrix;
+
+typedef struct _binary_matrix_header { // O cabeçalho de uma matriz binária,
+                                       // estendido com zeros até
+                                       // BINARY_MATRIX_HEADER_SIZE bytes
+  char magic[BINARY_MATRIX_MAGIC_SIZE]; // BINARY_MATRIX_MAGIC
+  int n;                                // O número de linhas e colunas
+  int weight_size; // O tamanho de cada peso, em bytes (1, 2 ou 4)
+  int stride;      // O número de pesos entre o início de duas linhas
+} binary_matrix_header;
+
+// A linha i da matriz
+#define MATRIX_ROW(matrix, i)                                                  \
+  ((matrix)->weights + (size_t)(i) * (matrix)->stride)
+// O custo da aresta (i, j) da matriz
+#define EDGE_COST(matrix, i, j) (MATRIX_ROW(matrix, i)[j])
+
+typedef struct _path { // Um caminho
+  int cost;            // Custo do caminho até então
+  int size;            // Número de nós no caminho
+  int nodes[];         // Os nós no caminho, com espaço para max_path_size nós
 } path;
 
 typedef struct _path_list { // Uma lista de caminhos alocados dinamicamente. Os
@@ -52,104 +182,812 @@ typedef struct _path_list { // Uma lista de caminhos alocados dinamicamente. Os
   path **paths;
   int size;
   int _actual_size;
+  path *_initial_paths[PATH_LIST_SIZE]; // Espaço inicial de paths, para que
+                                        // listas pequenas não façam alocações
+  int cost;        // O custo dos caminhos, se count > 0
+  long long count; // O número de caminhos com esse custo, guardados ou não
+  int limit;       // Máximo de caminhos guardados, ou PATH_LIST_UNLIMITED
+  FILE *stream;    // Se não for NULL, os caminhos são escritos nesse arquivo
+                   // ao invés de guardados
 } path_list;
 
+typedef struct _assignment { // Uma solução do problema de designação dos
+                             // nós restantes de um caminho (veja
+                             // get_assignment_bound). Os vetores ficam em um
+                             // único bloco de 4n + 2 inteiros, a partir de
+                             // successors.
+  int *successors;        // O sucessor de cada nó, ou -1
+  int *predecessors;      // O antecessor de cada nó, ou -1, mais o da coluna
+                          // virtual n, usada em augment_assignment
+  int *row_potentials;    // As variáveis duais das linhas (nós de origem)
+  int *column_potentials; // As variáveis duais das colunas, mais a virtual
+  int solved; // Se a solução corresponde ao caminho atual com esse tamanho
+} assignment;
+
+typedef struct _lower_bound { // Os limitantes inferiores de uma busca: o do
+                              // problema de designação e o 1-tree, com as
+                              // penalidades lagrangianas dos nós
+  int n;                      // O número de nós no grafo
+  assignment *assignments;    // A solução da designação de cada tamanho do
+                              // caminho, de 0 a n
+  int *columns;               // As colunas da designação
+  int *slacks;                // A menor folga de cada coluna
+  int *ways;                  // A coluna anterior a cada coluna no caminho
+                              // aumentante
+  int *used;                  // Se cada coluna já está no caminho aumentante
+  int *costs;         // A matriz n x n do menor custo entre os dois sentidos
+                      // de cada aresta, ou COST_INFINITE se não há nenhum
+  double *penalties;  // A penalidade de cada nó, refinada a cada cálculo
+  int *nodes;         // Os nós não visitados
+  int *parents;       // O pai de cada nó na árvore geradora mínima, ou -1
+                      // depois que o nó é adicionado a ela
+  int *degrees;       // O grau de cada nó na 1-tree
+  double *distances;  // A menor distância de cada nó até a árvore
+} lower_bound;
+
+typedef struct _search { // O estado de uma busca em profundidade
+  int n;                 // O número de nós no grafo
+  cost_matrix *adj;      // A matriz de adjacências do grafo
+  path *current;         // O caminho atual, modificado no lugar pela busca
+  unsigned long long *unvisited; // Máscara dos nós ainda não visitados, com
+                                 // SET_WORDS(n) palavras
+  int *best_cost;               // O melhor custo conhecido, ou NULL. É
+                                // compartilhado pelas threads do processo.
+  path_list *res;               // Os caminhos de menor custo encontrados
+  long long *counters;          // Os contadores da busca (COUNTER_*)
+  lower_bound *bound; // O limitante inferior usado na poda, ou NULL
+} search;
+
+// Um kernel de busca especializado para um número fixo de nós
+typedef void (*search_kernel)(search *s, int size, unsigned int unvisited,
+                              int cost);
+
+// Uma implementação de evaluate_leaves, para um conjunto de instruções
+typedef unsigned int (*leaf_kernel)(const int *edges, int *minimum);
+
+typedef struct _arena_chunk { // Um bloco de memória de uma arena
+  struct _arena_chunk *next;  // O próximo bloco da arena
+  size_t used;                // Número de bytes já utilizados
+  size_t capacity;            // Número de bytes do bloco
+  _Alignas(16) char data[];   // A memória do bloco
+} arena_chunk;
+
+typedef struct _arena { // Um alocador que reserva memória em blocos grandes e
+                        // libera tudo de uma só vez. Espaços liberados
+                        // individualmente são reaproveitados por tamanho.
+  arena_chunk *chunks;  // A lista de blocos da arena
+  arena_chunk *current; // O bloco onde ocorrem as próximas alocações
+  void *free_lists[ARENA_SIZE_CLASSES]; // Espaços liberados, por tamanho
+} arena;
+
+typedef struct _options { // Opções de execução lidas da linha de comando
+  int n;                  // Número de cidades
+  int branch_and_bound;   // Se a poda por branch and bound está habilitada
+  int solver;             // O algoritmo (SOLVER_DFS ou SOLVER_HELD_KARP)
+  int output;             // O modo de saída (OUTPUT_*)
+  char *output_file;      // O arquivo de saída do modo OUTPUT_STREAM
+  char *input_file;       // O arquivo da matriz de custos, ou NULL para
+                          // gerar uma matriz aleatória
+  char *batch_file;       // A lista de instâncias do modo em lote, ou NULL
+  int seed;               // A semente da matriz aleatória, ou SEED_FROM_TIME
+  int timing;             // Se o tempo de cada fase deve ser impresso
+  int stats;              // Se os contadores da busca devem ser impressos
+  int split_depth;        // Número de nós no prefixo de cada tarefa
+  char *checkpoint_file;  // O prefixo dos arquivos de checkpoint, ou NULL
+} options;
+
+typedef struct _task_queue { // A fila das tarefas da busca em profundidade.
+                             // Cada tarefa é um prefixo de caminho, e todos
+                             // os processos conhecem a lista completa.
+  int *tasks;       // count prefixos de depth nós, após STARTING_NODE
+  int count;        // O número de tarefas
+  int depth;        // O número de nós em cada prefixo
+  int next;         // A próxima tarefa a ser entregue (apenas na manager)
+  int exhausted;    // Se a manager já avisou que não há mais tarefas
+  int rank;         // O rank do processo dono da fila
+  char *finished;   // Se cada tarefa já foi resolvida em uma execução
+                    // anterior (apenas na manager), ou NULL
+  FILE *checkpoint; // O checkpoint do processo, ou NULL
+  double synced_at; // O horário da última gravação do checkpoint em disco
+} task_queue;
+
+typedef struct _checkpoint_header { // O cabeçalho de um arquivo de
+                                    // checkpoint, que identifica a instância
+                                    // e a divisão em tarefas
+  char magic[CHECKPOINT_MAGIC_SIZE]; // CHECKPOINT_MAGIC
+  int n;                             // O número de nós no grafo
+  int depth;  // O número de nós no prefixo de cada tarefa
+  int output; // O modo de saída (OUTPUT_*), que define os caminhos guardados
+  unsigned long long hash; // O hash dos pesos (veja get_matrix_hash)
+} checkpoint_header;
+
+typedef struct _task_context { // O estado compartilhado pelas tarefas OpenMP
+                               // de um processo
+  int n;                       // O número de nós no grafo
+  cost_matrix *adj;            // A matriz de adjacências do grafo
+  int branch_and_bound;        // Se a poda por branch and bound está habilitada
+  int best_cost;               // O melhor custo conhecido pelas threads
+  path_list **pll;             // Os caminhos encontrados por cada thread
+  lower_bound **bounds;        // Os limitantes inferiores de cada thread, ou
+                               // NULL sem branch and bound
+} task_context;
+
+typedef struct _batch { // Uma lista de instâncias resolvidas em lote. Só a
+                        // manager lê a lista e imprime as respostas.
+  FILE *list;           // A lista de instâncias, ou NULL nos workers
+  int ended;            // Se a lista já terminou
+  int failed;           // Se alguma matriz não pôde ser lida
+  int count;            // O número de instâncias lidas até então
+  int printed;          // O número de respostas já impressas
+  int capacity;         // O tamanho de headers e outputs
+  char **headers;       // O cabeçalho de cada instância ainda não impressa
+  char **outputs;       // A resposta de cada instância, ou NULL enquanto ela
+                        // não foi resolvida
+  int exhausted;        // Se o processo já foi avisado de que a lista terminou
+  int rank;             // O rank do processo
+} batch;
+
+typedef struct _held_karp_layer { // A parte de uma camada do Held-Karp que
+                                  // pertence a um processo. Uma camada contém
+                                  // todos os subconjuntos de um mesmo tamanho.
+  unsigned int *masks; // Os subconjuntos desse processo, em ordem crescente
+  int *costs;          // size custos por subconjunto, um por último nó
+  long long first;     // A posição do primeiro subconjunto na camada
+  long long count;     // O número de subconjuntos desse processo
+  long long total;     // O número de subconjuntos na camada
+  int size;            // O tamanho dos subconjuntos
+} held_karp_layer;
+
+typedef struct _held_karp_state { // Um estado do Held-Karp
+  unsigned int mask;              // O subconjunto de nós visitados
+  int last;                       // O bit do último nó visitado
+  int cost;                       // O custo mínimo do estado
+} held_karp_state;
+
+// Coeficientes binomiais, utilizados para numerar os subconjuntos
+long long binomials[HELD_KARP_MAX_SIZE + 1][HELD_KARP_MAX_SIZE + 1];
+
+// O número máximo de nós em um caminho (n + 1), definido em tempo de execução.
+// É próprio de cada thread, já que no modo em lote cada uma resolve
+// instâncias de tamanhos diferentes.
+int max_path_size = 0;
+#pragma omp threadprivate(max_path_size)
+
+// O tempo gasto em cada fase da execução, em segundos
+double phase_times[PHASES];
+
+// O número de bytes enviados e recebidos na coleta das respostas
+long long gather_bytes_sent = 0;
+long long gather_bytes_received = 0;
+
+// O nome de cada fase, como impresso por print_phase_times
+const char *phase_names[PHASES] = {"generation", "search", "gather", "merge",
+                                   "output"};
+
+// Os contadores da busca de cada thread, com COUNTERS posições por thread
+long long *search_counters = NULL;
+
+// A arena onde são alocados os paths e path lists, própria de cada thread
+arena *path_arena = NULL;
+#pragma omp threadprivate(path_arena)
+
+// As ordens dos LEAF_LEVELS nós dos níveis finais, em ordem lexicográfica
+int leaf_permutations[LEAF_PERMUTATIONS][LEAF_LEVELS];
+
+/* A posição em edges (veja search_leaves) da k-ésima aresta de cada ordem,
+alinhada para as leituras vetoriais */
+_Alignas(32) int leaf_edges[LEAF_LEVELS + 1][LEAF_PERMUTATIONS];
+
 /*
 *********** Utilidades para matrizes ***********
 */
 
 /**
- * Aloca dinamicamente uma matriz
+ * Calcula a distância entre o início de duas linhas de uma matriz. Cada
+ * linha é estendida até um múltiplo de CACHE_LINE_SIZE bytes.
  *
- * @param n o número de linhas da matriz
- * @param m o número de colunas da matriz
+ * @param n o número de colunas
  *
- * @return a matriz alocada
+ * @returns o número de pesos entre o início de duas linhas
  */
-int **new_matrix(int n, int m) {
-  int **matrix = (int **)malloc(n * sizeof(int *));
-  for (int i = 0; i < n; i++) {
-    matrix[i] = (int *)malloc(m * sizeof(int));
+int get_matrix_stride(int n) {
+  int row_size = n * sizeof(weight);
+  row_size = ((row_size + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE) *
+             CACHE_LINE_SIZE;
+  return row_size / sizeof(weight);
+}
+
+/**
+ * Aloca dinamicamente uma matriz quadrada contígua, guardada linha a linha.
+ * Cada linha é estendida até um múltiplo de CACHE_LINE_SIZE bytes, e a
+ * matriz começa no início de uma linha de cache, de forma que uma linha
+ * da matriz ocupe o menor número possível de linhas de cache.
+ *
+ * @param n o número de linhas e colunas
+ *
+ * @returns a matriz alocada
+ */
+cost_matrix *new_matrix(int n) {
+  cost_matrix *matrix = (cost_matrix *)malloc(1 * sizeof(cost_matrix));
+
+  matrix->n = n;
+  matrix->stride = get_matrix_stride(n);
+  matrix->mapping = NULL;
+  matrix->mapping_size = 0;
+  size_t size = (n > 0) ? (size_t)n * matrix->stride * sizeof(weight)
+                        : CACHE_LINE_SIZE;
+  matrix->weights = (weight *)aligned_alloc(CACHE_LINE_SIZE, size);
+  memset(matrix->weights, 0, size);
+  return matrix;
+}
+
+/**
+ * Libera o espaço utilizado por uma matriz
+ *
+ * @param matrix a matriz a ser liberada
+ *
+ * @returns void
+ */
+void delete_matrix(cost_matrix *matrix) {
+  if (matrix->mapping != NULL) {
+    munmap(matrix->mapping, matrix->mapping_size);
+  } else {
+    free(matrix->weights);
+  }
+  free(matrix);
+  matrix = NULL;
+}
+
+/**
+ * Imprime uma matriz, para fins de debug
+ *
+ * @param stream o arquivo onde a matriz é impressa
+ * @param matrix a matriz a ser impressa
+ *
+ * @returns void
+ */
+void print_matrix(FILE *stream, cost_matrix *matrix) {
+  for (int i = 0; i < matrix->n; i++) {
+    weight *row = MATRIX_ROW(matrix, i);
+    for (int j = 0; j < matrix->n; j++) {
+      fprintf(stream, "%02d ", row[j]);
+    }
+    fprintf(stream, "\n");
+  }
+  fprintf(stream, "\n");
+}
+
+/*
+****** Utilidades para leitura de arquivos ******
+*/
+
+/**
+ * Lê o valor de uma palavra-chave de um arquivo TSPLIB, no formato
+ * "PALAVRA : VALOR" ou "PALAVRA: VALOR"
+ *
+ * @param line a linha do arquivo
+ * @param value onde o valor é escrito, com até TSPLIB_MAX_VALUE caracteres
+ *
+ * @returns void
+ */
+void read_tsplib_value(char *line, char *value) {
+  char *start = strchr(line, ':');
+  value[0] = '\0';
+  if (start != NULL) {
+    sscanf(start + 1, " %31s", value);
+  }
+}
+
+/**
+ * Verifica se a entrada (i, j) de uma matriz aparece em uma seção
+ * EDGE_WEIGHT_SECTION de um arquivo TSPLIB, que é lida linha a linha
+ *
+ * @param format o formato da seção (EDGE_WEIGHT_FORMAT)
+ * @param i a linha da entrada
+ * @param j a coluna da entrada
+ *
+ * @returns 1 se a entrada aparece no arquivo, 0 caso contrário
+ */
+int is_tsplib_entry(char *format, int i, int j) {
+  if (strcmp(format, "FULL_MATRIX") == 0) {
+    return 1;
+  } else if (strcmp(format, "UPPER_ROW") == 0) {
+    return j > i;
+  } else if (strcmp(format, "LOWER_ROW") == 0) {
+    return j < i;
+  } else if (strcmp(format, "UPPER_DIAG_ROW") == 0) {
+    return j >= i;
+  } else {
+    return j <= i; // LOWER_DIAG_ROW
+  }
+}
+
+/**
+ * Converte uma coordenada do tipo GEO do TSPLIB (graus.minutos) em radianos
+ *
+ * @param coordinate a coordenada
+ *
+ * @returns a coordenada em radianos
+ */
+double get_tsplib_radians(double coordinate) {
+  double degrees = (int)coordinate;
+  double minutes = coordinate - degrees;
+  return TSPLIB_PI * (degrees + 5.0 * minutes / 3.0) / 180.0;
+}
+
+/**
+ * Calcula a distância entre duas cidades de um arquivo TSPLIB, com as
+ * fórmulas da especificação do formato
+ *
+ * @param type o tipo das distâncias (EDGE_WEIGHT_TYPE)
+ * @param x as primeiras coordenadas das cidades
+ * @param y as segundas coordenadas das cidades
+ * @param i a primeira cidade
+ * @param j a segunda cidade
+ *
+ * @returns a distância entre as cidades
+ */
+long long get_tsplib_distance(char *type, double *x, double *y, int i, int j) {
+  double dx = x[i] - x[j];
+  double dy = y[i] - y[j];
+
+  if (strcmp(type, "ATT") == 0) {
+    double r = sqrt((dx * dx + dy * dy) / 10.0);
+    long long t = (long long)(r + 0.5);
+    return (t < r) ? t + 1 : t;
+  } else if (strcmp(type, "GEO") == 0) {
+    double latitude_i = get_tsplib_radians(x[i]);
+    double longitude_i = get_tsplib_radians(y[i]);
+    double latitude_j = get_tsplib_radians(x[j]);
+    double longitude_j = get_tsplib_radians(y[j]);
+    double q1 = cos(longitude_i - longitude_j);
+    double q2 = cos(latitude_i - latitude_j);
+    double q3 = cos(latitude_i + latitude_j);
+    return (long long)(TSPLIB_EARTH_RADIUS *
+                           acos(0.5 * ((1.0 + q1) * q2 - (1.0 - q1) * q3)) +
+                       1.0);
+  } else {
+    return (long long)(sqrt(dx * dx + dy * dy) + 0.5); // EUC_2D
+  }
+}
+
+/**
+ * Verifica se um peso lido de um arquivo cabe na matriz de custos
+ *
+ * @param w o peso
+ * @param filename o nome do arquivo, para a mensagem de erro
+ *
+ * @returns 0 se o peso for válido, 1 caso contrário
+ */
+int check_file_weight(long long w, char *filename) {
+  if (w < 0 || w > MAX_COST) {
+    printf("O arquivo %s tem o peso %lld, fora do intervalo [0, %d]. "
+           "Recompile o programa com um MAX_COST maior (ex.: com "
+           "DEFINES=-DMAX_COST=65535 no make).\n",
+           filename, w, MAX_COST);
+    return 1;
+  }
+
+  return 0;
+}
+
+/**
+ * Lê uma matriz de custos de um arquivo no formato TSPLIB. São suportados
+ * os tipos EXPLICIT (nos formatos FULL_MATRIX, UPPER_ROW, LOWER_ROW,
+ * UPPER_DIAG_ROW e LOWER_DIAG_ROW), EUC_2D, ATT e GEO.
+ *
+ * @param filename o nome do arquivo
+ * @param file o arquivo, já aberto
+ *
+ * @returns a matriz de custos, ou NULL em caso de erro
+ */
+cost_matrix *read_tsplib_matrix(char *filename, FILE *file) {
+  char line[TSPLIB_MAX_LINE];
+  char keyword[TSPLIB_MAX_VALUE + 1];
+  char type[TSPLIB_MAX_VALUE + 1] = "EXPLICIT";
+  char format[TSPLIB_MAX_VALUE + 1] = "FULL_MATRIX";
+  int n = 0;
+
+  while (fgets(line, TSPLIB_MAX_LINE, file) != NULL) {
+    keyword[0] = '\0';
+    sscanf(line, " %31[A-Z_0-9]", keyword);
+
+    if (strcmp(keyword, "DIMENSION") == 0) {
+      char value[TSPLIB_MAX_VALUE + 1];
+      read_tsplib_value(line, value);
+      n = atoi(value);
+    } else if (strcmp(keyword, "EDGE_WEIGHT_TYPE") == 0) {
+      read_tsplib_value(line, type);
+    } else if (strcmp(keyword, "EDGE_WEIGHT_FORMAT") == 0) {
+      read_tsplib_value(line, format);
+    } else if (strcmp(keyword, "NODE_COORD_SECTION") == 0 ||
+               strcmp(keyword, "EDGE_WEIGHT_SECTION") == 0 ||
+               strcmp(keyword, "EOF") == 0) {
+      break;
+    }
+  }
+
+  if (n <= 0) {
+    printf("O arquivo %s não define DIMENSION.\n", filename);
+    return NULL;
+  }
+
+  int explicit = strcmp(type, "EXPLICIT") == 0;
+  if (strcmp(keyword, explicit ? "EDGE_WEIGHT_SECTION"
+                               : "NODE_COORD_SECTION") != 0) {
+    printf("O arquivo %s não tem a seção %s.\n", filename,
+           explicit ? "EDGE_WEIGHT_SECTION" : "NODE_COORD_SECTION");
+    return NULL;
+  }
+
+  if (explicit && strcmp(format, "FULL_MATRIX") != 0 &&
+      strcmp(format, "UPPER_ROW") != 0 && strcmp(format, "LOWER_ROW") != 0 &&
+      strcmp(format, "UPPER_DIAG_ROW") != 0 &&
+      strcmp(format, "LOWER_DIAG_ROW") != 0) {
+    printf("Formato EDGE_WEIGHT_FORMAT não suportado: %s\n", format);
+    return NULL;
+  }
+
+  if (!explicit && strcmp(type, "EUC_2D") != 0 && strcmp(type, "ATT") != 0 &&
+      strcmp(type, "GEO") != 0) {
+    printf("Tipo EDGE_WEIGHT_TYPE não suportado: %s\n", type);
+    return NULL;
+  }
+
+  cost_matrix *matrix = new_matrix(n);
+  int error = 0;
+
+  if (explicit) {
+    int symmetric = strcmp(format, "FULL_MATRIX") != 0;
+    for (int i = 0; i < n && !error; i++) {
+      for (int j = 0; j < n && !error; j++) {
+        long long w;
+        if (!is_tsplib_entry(format, i, j)) {
+          continue;
+        } else if (fscanf(file, "%lld", &w) != 1) {
+          printf("O arquivo %s tem menos pesos que o esperado.\n", filename);
+          error = 1;
+        } else if (!(error = check_file_weight(w, filename))) {
+          EDGE_COST(matrix, i, j) = (i == j) ? 0 : w;
+          if (symmetric) {
+            EDGE_COST(matrix, j, i) = EDGE_COST(matrix, i, j);
+          }
+        }
+      }
+    }
+  } else {
+    double *x = (double *)malloc(n * sizeof(double));
+    double *y = (double *)malloc(n * sizeof(double));
+    for (int i = 0; i < n && !error; i++) {
+      int node;
+      if (fscanf(file, "%d %lf %lf", &node, &x[i], &y[i]) != 3) {
+        printf("O arquivo %s tem menos coordenadas que o esperado.\n",
+               filename);
+        error = 1;
+      }
+    }
+    for (int i = 0; i < n && !error; i++) {
+      for (int j = 0; j < n && !error; j++) {
+        long long w = (i == j) ? 0 : get_tsplib_distance(type, x, y, i, j);
+        if (!(error = check_file_weight(w, filename))) {
+          EDGE_COST(matrix, i, j) = w;
+        }
+      }
+    }
+    free(x);
+    free(y);
+  }
+
+  if (error) {
+    delete_matrix(matrix);
+    return NULL;
   }
 
   return matrix;
 }
 
 /**
- * Aloca dinamicamente uma matriz com linhas de vários
- * tamanhos especificados em v
+ * Lê um peso de uma matriz binária
+ *
+ * @param data os pesos da matriz binária
+ * @param header o cabeçalho da matriz binária
+ * @param i a linha do peso
+ * @param j a coluna do peso
+ *
+ * @returns o peso
+ */
+long long get_binary_weight(unsigned char *data, binary_matrix_header *header,
+                            int i, int j) {
+  unsigned char *entry =
+      data + ((size_t)i * header->stride + j) * header->weight_size;
+  if (header->weight_size == 1) {
+    return *entry;
+  } else if (header->weight_size == 2) {
+    unsigned short w;
+    memcpy(&w, entry, sizeof(w));
+    return w;
+  } else {
+    unsigned int w;
+    memcpy(&w, entry, sizeof(w));
+    return w;
+  }
+}
+
+/**
+ * Lê uma matriz de custos de um arquivo binário, mapeando o arquivo em
+ * memória. Quando o tamanho dos pesos e a distância entre as linhas do
+ * arquivo são os mesmos da matriz, os pesos são usados direto do
+ * mapeamento, sem cópia.
  *
- * @param n o número de linhas da matriz
- * @param v o número de colunas de cada linha
+ * @param filename o nome do arquivo
+ * @param fd o descritor do arquivo, já aberto
  *
- * @return a matriz alocada
+ * @returns a matriz de custos, ou NULL em caso de erro
  */
-int **new_matrixv(int n, int *v) {
-  int **matrix = (int **)malloc(n * sizeof(int *));
+cost_matrix *read_binary_matrix(char *filename, int fd) {
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size < BINARY_MATRIX_HEADER_SIZE) {
+    printf("O arquivo %s não é uma matriz binária válida.\n", filename);
+    return NULL;
+  }
+
+  size_t mapping_size = info.st_size;
+  void *mapping = mmap(NULL, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (mapping == MAP_FAILED) {
+    printf("Não foi possível mapear o arquivo %s.\n", filename);
+    return NULL;
+  }
+
+  binary_matrix_header *header = (binary_matrix_header *)mapping;
+  unsigned char *data = (unsigned char *)mapping + BINARY_MATRIX_HEADER_SIZE;
+  int n = header->n;
+  int valid = n > 0 && header->stride >= n &&
+              (header->weight_size == 1 || header->weight_size == 2 ||
+               header->weight_size == 4) &&
+              (mapping_size - BINARY_MATRIX_HEADER_SIZE) /
+                      header->weight_size / header->stride >=
+                  (size_t)n;
+  if (!valid) {
+    printf("O arquivo %s não é uma matriz binária válida.\n", filename);
+    munmap(mapping, mapping_size);
+    return NULL;
+  }
+
+  int zero_diagonal = 1;
   for (int i = 0; i < n; i++) {
-    matrix[i] = (int *)malloc(v[i] * sizeof(int));
+    for (int j = 0; j < n; j++) {
+      long long w = get_binary_weight(data, header, i, j);
+      if (i == j) {
+        zero_diagonal = zero_diagonal && w == 0;
+      } else if (check_file_weight(w, filename)) {
+        munmap(mapping, mapping_size);
+        return NULL;
+      }
+    }
+  }
+
+  cost_matrix *matrix;
+  if ((size_t)header->weight_size == sizeof(weight) &&
+      header->stride == get_matrix_stride(n) && zero_diagonal) {
+    matrix = (cost_matrix *)malloc(1 * sizeof(cost_matrix));
+    matrix->n = n;
+    matrix->stride = header->stride;
+    matrix->weights = (weight *)data;
+    matrix->mapping = mapping;
+    matrix->mapping_size = mapping_size;
+  } else {
+    matrix = new_matrix(n);
+    for (int i = 0; i < n; i++) {
+      weight *row = MATRIX_ROW(matrix, i);
+      for (int j = 0; j < n; j++) {
+        row[j] = (i == j) ? 0 : get_binary_weight(data, header, i, j);
+      }
+    }
+    munmap(mapping, mapping_size);
   }
 
   return matrix;
 }
 
 /**
- * Aloca dinamicamente uma matriz quadrada
- * (mesmo número de linhas e colunas)
+ * Lê uma matriz de custos de um arquivo, que pode ser uma matriz binária
+ * (começando com BINARY_MATRIX_MAGIC) ou um arquivo TSPLIB
  *
- * @param n o número de linhas e colunas
+ * @param filename o nome do arquivo
  *
- * @returns a matriz alocada
+ * @returns a matriz de custos, ou NULL em caso de erro
  */
-int **new_square_matrix(int n) { return new_matrix(n, n); }
+cost_matrix *read_cost_matrix(char *filename) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    printf("Não foi possível abrir o arquivo %s.\n", filename);
+    return NULL;
+  }
+
+  char magic[BINARY_MATRIX_MAGIC_SIZE];
+  ssize_t read_size = read(fd, magic, BINARY_MATRIX_MAGIC_SIZE);
+  cost_matrix *matrix;
+  if (read_size == BINARY_MATRIX_MAGIC_SIZE &&
+      memcmp(magic, BINARY_MATRIX_MAGIC, BINARY_MATRIX_MAGIC_SIZE) == 0) {
+    matrix = read_binary_matrix(filename, fd);
+    close(fd);
+  } else {
+    lseek(fd, 0, SEEK_SET);
+    FILE *file = fdopen(fd, "r");
+    matrix = read_tsplib_matrix(filename, file);
+    fclose(file);
+  }
+
+  return matrix;
+}
+
+/*
+************* Utilidades para arenas *************
+*/
 
 /**
- * Libera o espaço utilizado por uma matriz
+ * Obtém a classe de tamanho de uma alocação em uma arena. Alocações de
+ * até ARENA_SMALL_CLASSES * 16 bytes são agrupadas de 16 em 16 bytes, e
+ * as maiores em potências de 2.
  *
- * @param matrix a matriz a ser liberada
- * @param n o número de linhas da matriz
+ * @param size o tamanho da alocação
+ * @param rounded um ponteiro para a variável que armazenará o tamanho
+ * efetivamente reservado para a alocação
+ *
+ * @returns o índice da classe de tamanho
+ */
+int get_arena_size_class(size_t size, size_t *rounded) {
+  if (size <= ARENA_SMALL_CLASSES * 16) {
+    int size_class = (size == 0) ? 0 : (int)((size - 1) / 16);
+    *rounded = (size_class + 1) * 16;
+    return size_class;
+  }
+
+  int size_class = ARENA_SMALL_CLASSES;
+  *rounded = ARENA_SMALL_CLASSES * 32;
+  while (*rounded < size) {
+    *rounded *= 2;
+    size_class++;
+  }
+
+  return size_class;
+}
+
+/**
+ * Aloca um novo bloco de memória para uma arena
+ *
+ * @param size o tamanho mínimo do bloco
+ *
+ * @returns o bloco alocado, vazio
+ */
+arena_chunk *new_arena_chunk(size_t size) {
+  size_t capacity = (size > ARENA_CHUNK_SIZE) ? size : ARENA_CHUNK_SIZE;
+  arena_chunk *chunk =
+      (arena_chunk *)malloc(sizeof(arena_chunk) + capacity * sizeof(char));
+  chunk->next = NULL;
+  chunk->used = 0;
+  chunk->capacity = capacity;
+  return chunk;
+}
+
+/**
+ * Cria uma nova arena vazia
+ *
+ * @returns uma arena alocada dinamicamente
+ */
+arena *new_arena() {
+  arena *a = (arena *)malloc(1 * sizeof(arena));
+  a->chunks = new_arena_chunk(ARENA_CHUNK_SIZE);
+  a->current = a->chunks;
+  for (int i = 0; i < ARENA_SIZE_CLASSES; i++) {
+    a->free_lists[i] = NULL;
+  }
+  return a;
+}
+
+/**
+ * Libera uma arena e, de uma só vez, tudo o que foi alocado nela
+ *
+ * @param a a arena a ser liberada
  *
  * @returns void
  */
-void delete_matrix(int **matrix, int n) {
-  for (int i = 0; i < n; i++) {
-    free(matrix[i]);
+void delete_arena(arena *a) {
+  arena_chunk *chunk = a->chunks;
+  while (chunk != NULL) {
+    arena_chunk *next = chunk->next;
+    free(chunk);
+    chunk = next;
   }
-  free(matrix);
-  matrix = NULL;
+  free(a);
+  a = NULL;
 }
 
 /**
- * Imprime uma matriz, para fins de debug
+ * Descarta, de uma só vez, tudo o que foi alocado em uma arena, mantendo
+ * os seus blocos para as próximas alocações
  *
- * @param matrix a matriz a ser impressa
- * @param n o número de linhas da matriz
- * @param m o número de colunas da matriz
+ * @param a a arena
  *
  * @returns void
  */
-void print_matrix(int **matrix, int n, int m) {
-  for (int i = 0; i < n; i++) {
-    for (int j = 0; j < m; j++) {
-      printf("%02d ", matrix[i][j]);
+void arena_reset(arena *a) {
+  for (arena_chunk *chunk = a->chunks; chunk != NULL; chunk = chunk->next) {
+    chunk->used = 0;
+  }
+  a->current = a->chunks;
+  for (int i = 0; i < ARENA_SIZE_CLASSES; i++) {
+    a->free_lists[i] = NULL;
+  }
+}
+
+/**
+ * Aloca memória em uma arena. Espaços liberados com arena_free são
+ * reutilizados antes de se avançar no bloco atual.
+ *
+ * @param a a arena
+ * @param size o tamanho da alocação
+ *
+ * @returns um ponteiro para a memória alocada
+ */
+void *arena_alloc(arena *a, size_t size) {
+  size_t rounded;
+  int size_class = get_arena_size_class(size, &rounded);
+
+  void *ptr = a->free_lists[size_class];
+  if (ptr != NULL) {
+    a->free_lists[size_class] = *(void **)ptr;
+    return ptr;
+  }
+
+  while (a->current->used + rounded > a->current->capacity) {
+    if (a->current->next == NULL) {
+      a->current->next = new_arena_chunk(rounded);
     }
-    printf("\n");
+    a->current = a->current->next;
   }
-  printf("\n");
+
+  ptr = a->current->data + a->current->used;
+  a->current->used += rounded;
+  return ptr;
+}
+
+/**
+ * Devolve à arena um espaço alocado com arena_alloc, para que seja
+ * reutilizado por outra alocação do mesmo tamanho
+ *
+ * @param a a arena onde o espaço foi alocado
+ * @param ptr o espaço a ser liberado
+ * @param size o tamanho passado a arena_alloc
+ *
+ * @returns void
+ */
+void arena_free(arena *a, void *ptr, size_t size) {
+  size_t rounded;
+  int size_class = get_arena_size_class(size, &rounded);
+  *(void **)ptr = a->free_lists[size_class];
+  a->free_lists[size_class] = ptr;
 }
 
 /*
 ************* Utilidades para paths *************
 */
 
+/**
+ * Obtém o tamanho, em bytes, de um path com espaço para max_path_size nós
+ *
+ * @returns o tamanho de um path
+ */
+size_t get_path_bytes() { return sizeof(path) + max_path_size * sizeof(int); }
+
 /**
  * Cria um novo path vazio
  *
- * @returns um path alocado dinamicamente
+ * @returns um path alocado na arena da thread
  */
 path *new_path() {
-  path *p = (path *)malloc(1 * sizeof(path));
-  for (int i = 0; i < MAX_PATH_SIZE; i++) {
+  path *p = (path *)arena_alloc(path_arena, get_path_bytes());
+  for (int i = 0; i < max_path_size; i++) {
     p->nodes[i] = -1;
   }
   p->cost = COST_NOT_COMPUTED;
@@ -158,12 +996,13 @@ path *new_path() {
 }
 
 /**
- * Libera a memória alocada para p
+ * Libera a memória alocada para p. O path deve ter sido alocado na arena
+ * da thread atual.
  *
  * @param p o path a ser desalocado
  */
 void delete_path(path *p) {
-  free(p);
+  arena_free(path_arena, p, get_path_bytes());
   p = NULL;
 }
 
@@ -177,7 +1016,7 @@ void delete_path(path *p) {
  */
 path *copy_path(path *original) {
   path *p = new_path();
-  memcpy(p->nodes, original->nodes, MAX_PATH_SIZE * sizeof(int));
+  memcpy(p->nodes, original->nodes, max_path_size * sizeof(int));
   p->size = original->size;
   p->cost = original->cost;
   return p;
@@ -206,10 +1045,11 @@ void concatenate_to_path(path *p, int n) { p->nodes[p->size++] = n; }
  *
  * @returns o custo do caminho p, de acordo com adj
  */
-int get_path_cost(path *p, int **adj) {
+int get_path_cost(path *p, cost_matrix *adj) {
   if (p->cost == COST_NOT_COMPUTED) {
+    p->cost = 0;
     for (int i = 0; i < (p->size - 1); i++) {
-      int current_cost = adj[p->nodes[i]][p->nodes[i + 1]];
+      int current_cost = EDGE_COST(adj, p->nodes[i], p->nodes[i + 1]);
       if (current_cost == MAX_COST) {
         p->cost = COST_INFINITE;
         break;
@@ -225,15 +1065,16 @@ int get_path_cost(path *p, int **adj) {
 /**
  * Imprime um caminho
  *
+ * @param stream o arquivo onde o caminho é impresso
  * @param p o caminho
  *
  * @returns void
  */
-void print_path(path *p) {
+void print_path(FILE *stream, path *p) {
   for (int i = 0; i < p->size - 1; i++) {
-    printf("%d -> ", p->nodes[i]);
+    fprintf(stream, "%d -> ", p->nodes[i]);
   }
-  printf("%d\n", p->nodes[p->size - 1]);
+  fprintf(stream, "%d\n", p->nodes[p->size - 1]);
 }
 
 /*
@@ -241,18 +1082,38 @@ void print_path(path *p) {
 */
 
 /**
- * Aloca uma nova path list dinamicamente
+ * Aloca uma nova path list na arena da thread
  *
- * @returns uma path list nova e vazia, alocada dinamicamente
+ * @returns uma path list nova e vazia, alocada na arena da thread
  */
 path_list *new_path_list() {
-  path_list *pl = (path_list *)malloc(1 * sizeof(path_list));
-  pl->paths = (path **)malloc(PATH_LIST_SIZE * sizeof(path *));
+  path_list *pl = (path_list *)arena_alloc(path_arena, sizeof(path_list));
+  pl->paths = pl->_initial_paths;
   pl->size = 0;
   pl->_actual_size = PATH_LIST_SIZE;
+  pl->cost = PATH_LIST_EMPTY;
+  pl->count = 0;
+  pl->limit = PATH_LIST_UNLIMITED;
+  pl->stream = NULL;
   return pl;
 }
 
+/**
+ * Define quais caminhos uma path list guarda, de acordo com o modo de saída.
+ * Em todos os modos, os caminhos de menor custo são contados.
+ *
+ * @param pl a path list, ainda vazia
+ * @param output o modo de saída (OUTPUT_*)
+ * @param stream o arquivo onde os caminhos são escritos no modo OUTPUT_STREAM
+ *
+ * @returns void
+ */
+void set_path_list_output(path_list *pl, int output, FILE *stream) {
+  pl->limit = (output == OUTPUT_ALL) ? PATH_LIST_UNLIMITED
+                                     : (output == OUTPUT_FIRST) ? 1 : 0;
+  pl->stream = (output == OUTPUT_STREAM) ? stream : NULL;
+}
+
 /**
  * Libera o espaço de uma path list, sem liberar
  * os paths dentro dela
@@ -262,8 +1123,10 @@ path_list *new_path_list() {
  * @returns void
  */
 void delete_path_list(path_list *pl) {
-  free(pl->paths);
-  free(pl);
+  if (pl->paths != pl->_initial_paths) {
+    arena_free(path_arena, pl->paths, pl->_actual_size * sizeof(path *));
+  }
+  arena_free(path_arena, pl, sizeof(path_list));
   pl = NULL;
 }
 
@@ -291,7 +1154,8 @@ void delete_path_list_paths(path_list *pl) {
  */
 
 path_list **new_path_list_list(int n) {
-  path_list **pll = (path_list **)malloc(n * sizeof(path_list *));
+  path_list **pll =
+      (path_list **)arena_alloc(path_arena, n * sizeof(path_list *));
   return pll;
 }
 
@@ -309,7 +1173,7 @@ void delete_path_list_list(path_list **pll, int n) {
     delete_path_list_paths(pll[i]);
     delete_path_list(pll[i]);
   }
-  free(pll);
+  arena_free(path_arena, pll, n * sizeof(path_list *));
   pll = NULL;
 }
 
@@ -325,7 +1189,12 @@ void delete_path_list_list(path_list **pll, int n) {
 void concatenate_to_path_list(path_list *pl, path *p) {
   if (pl->size == pl->_actual_size) { // Aloca espaço adicional se necessário
     int new_size = 2 * pl->_actual_size;
-    pl->paths = realloc(pl->paths, new_size * sizeof(path *));
+    path **paths = (path **)arena_alloc(path_arena, new_size * sizeof(path *));
+    memcpy(paths, pl->paths, pl->size * sizeof(path *));
+    if (pl->paths != pl->_initial_paths) {
+      arena_free(path_arena, pl->paths, pl->_actual_size * sizeof(path *));
+    }
+    pl->paths = paths;
     pl->_actual_size = new_size;
   }
 
@@ -339,330 +1208,3552 @@ void concatenate_to_path_list(path_list *pl, path *p) {
  * armazenar paths com o mesmo exato custo.
  *
  * @param pl a path list
- * @param adj a matriz de adjacências do grafo
  *
- * @returns o custo do primeiro caminhoa na path list ou PATH_LIST_EMPTY, se a
- * path list estiver vazia
+ * @returns o custo dos caminhos na path list ou PATH_LIST_EMPTY, se nenhum
+ * caminho foi registrado nela
  */
-int get_path_list_paths_cost(path_list *pl, int **adj) {
-  if (pl->size == 0) {
+int get_path_list_paths_cost(path_list *pl) {
+  if (pl->count == 0) {
     return PATH_LIST_EMPTY;
   }
 
-  return get_path_cost(pl->paths[0], adj);
+  return pl->cost;
 }
 
 /**
- * Serializa a path list em um array alocado dinamicamente
- * com vários paths de tamanho path_size
+ * Descarta os caminhos registrados em uma path list, inclusive os escritos
+ * no seu arquivo
  *
- * @param pl a path list a ser serializada
- * @param path_size o tamanho dos caminhos na path list
- * @return int*
+ * @param pl a path list
+ *
+ * @returns void
  */
-int *serialize_path_list(path_list *pl, int path_size) {
-  int *res = (int *)malloc((pl->size) * path_size * sizeof(int));
+void reset_path_list(path_list *pl) {
+  delete_path_list_paths(pl);
+  pl->count = 0;
 
-  for (int i = 0; i < pl->size; i++) {
-    /*memcpy não pode ser utilizado aqui por conta da memória
-    alocada estaticamente (pl->paths[i]->nodes)*/
-    for (int j = 0; j < path_size; j++) {
-      res[(path_size * i) + j] = pl->paths[i]->nodes[j];
+  if (pl->stream != NULL) {
+    fflush(pl->stream);
+    if (ftruncate(fileno(pl->stream), 0) != 0) {
+      printf("Não foi possível sobrescrever o arquivo de saída.\n");
+      MPI_Abort(MPI_COMM_WORLD, 1);
     }
+    rewind(pl->stream);
   }
-
-  return res;
 }
 
 /**
- * Desserializa uma path list serializada pela função
- * serialize_path_list
+ * Guarda uma cópia de p na path list, ou o escreve no arquivo da path list,
+ * sem contá-lo. Se a path list já guarda o máximo de caminhos, p é ignorado.
  *
- * @param spl a path list serializada
- * @param spl_size o comprimento de spl
- * @param path_size o tamanho dos caminhos em spl
+ * @param pl a path list
+ * @param p o path a ser guardado
+ *
+ * @returns void
+ */
+void store_path(path_list *pl, path *p) {
+  if (pl->stream != NULL) {
+    print_path(pl->stream, p);
+  } else if (pl->limit == PATH_LIST_UNLIMITED || pl->size < pl->limit) {
+    concatenate_to_path_list(pl, copy_path(p));
+  }
+}
+
+/**
+ * Registra um caminho de custo cost em uma path list. Se ele for mais barato
+ * que os caminhos registrados até então, eles são descartados; se for mais
+ * caro, é ignorado. Assim, a path list mantém apenas os caminhos de menor
+ * custo, dos quais guarda no máximo pl->limit.
+ *
+ * @param pl a path list
+ * @param p o caminho, que é copiado se precisar ser guardado
+ * @param cost o custo do caminho
+ *
+ * @returns void
+ */
+void add_to_path_list(path_list *pl, path *p, int cost) {
+  if (pl->count > 0 && cost > pl->cost) {
+    return;
+  }
+
+  if (pl->count > 0 && cost < pl->cost) {
+    reset_path_list(pl);
+  }
+
+  pl->cost = cost;
+  pl->count++;
+  p->cost = cost;
+  store_path(pl, p);
+}
+
+/**
+ * Copia todo o conteúdo de um arquivo para o fim de outro
+ *
+ * @param dest o arquivo de destino
+ * @param src o arquivo copiado, lido desde o início
+ *
+ * @returns void
+ */
+void copy_stream(FILE *dest, FILE *src) {
+  char buffer[STREAM_CHUNK_SIZE];
+  size_t read;
+
+  fflush(src);
+  rewind(src);
+  while ((read = fread(buffer, 1, STREAM_CHUNK_SIZE, src)) > 0) {
+    fwrite(buffer, 1, read, dest);
+  }
+}
+
+/**
+ * Envia todo o conteúdo de um arquivo para outro processo, em blocos de até
+ * STREAM_CHUNK_SIZE bytes. O fim do arquivo é indicado por um bloco vazio.
+ *
+ * @param stream o arquivo enviado, lido desde o início
+ * @param dest o rank do processo que recebe o arquivo
+ *
+ * @returns void
+ */
+void send_stream(FILE *stream, int dest) {
+  char buffer[STREAM_CHUNK_SIZE];
+  size_t read;
+
+  fflush(stream);
+  rewind(stream);
+  do {
+    read = fread(buffer, 1, STREAM_CHUNK_SIZE, stream);
+    MPI_Send(buffer, (int)read, MPI_CHAR, dest, TAG_STREAM, MPI_COMM_WORLD);
+    gather_bytes_sent += read;
+  } while (read > 0);
+}
+
+/**
+ * Recebe um arquivo enviado com send_stream, escrevendo-o no fim de dest
+ *
+ * @param dest o arquivo de destino
+ * @param source o rank do processo que envia o arquivo
+ *
+ * @returns void
+ */
+void receive_stream(FILE *dest, int source) {
+  char buffer[STREAM_CHUNK_SIZE];
+  int received;
+
+  do {
+    MPI_Status status;
+    MPI_Recv(buffer, STREAM_CHUNK_SIZE, MPI_CHAR, source, TAG_STREAM,
+             MPI_COMM_WORLD, &status);
+    MPI_Get_count(&status, MPI_CHAR, &received);
+    fwrite(buffer, 1, received, dest);
+    gather_bytes_received += received;
+  } while (received > 0);
+}
+
+/**
+ * Obtém o número de bits usados para cada nó em um caminho empacotado
+ *
+ * @param n o número de nós no grafo
+ *
+ * @returns o menor número de bits que representa os nós de 0 a n - 1
+ */
+int get_node_bits(int n) {
+  int bits = 1;
+  while ((1ll << bits) < n) {
+    bits++;
+  }
+  return bits;
+}
+
+/**
+ * Obtém o tamanho, em bytes, de um caminho empacotado. Os nós inicial e final
+ * (sempre STARTING_NODE) não são armazenados, e cada um dos n - 1 nós
+ * restantes ocupa get_node_bits(n) bits. Cada caminho começa em um byte novo.
+ *
+ * @param n o número de nós no grafo
+ *
+ * @returns o tamanho de um caminho empacotado
+ */
+int get_packed_path_size(int n) {
+  return ((n - 1) * get_node_bits(n) + 7) / 8;
+}
+
+/**
+ * Serializa a path list em um array alocado dinamicamente, com cada caminho
+ * empacotado em get_packed_path_size(n) bytes
+ *
+ * @param pl a path list a ser serializada
+ * @param n o número de nós no grafo
+ * @return os caminhos empacotados
+ */
+unsigned char *serialize_path_list(path_list *pl, int n) {
+  int bits = get_node_bits(n);
+  int packed_size = get_packed_path_size(n);
+  unsigned char *res =
+      (unsigned char *)malloc((size_t)pl->size * packed_size + 1);
+
+  for (int i = 0; i < pl->size; i++) {
+    unsigned char *packed = res + ((size_t)packed_size * i);
+    unsigned long long buffer = 0; // Bits ainda não escritos
+    int buffered = 0;              // Número de bits em buffer
+    int k = 0;
+
+    for (int j = 1; j < n; j++) {
+      buffer |= (unsigned long long)pl->paths[i]->nodes[j] << buffered;
+      buffered += bits;
+      while (buffered >= 8) {
+        packed[k++] = buffer & 0xFF;
+        buffer >>= 8;
+        buffered -= 8;
+      }
+    }
+
+    if (buffered > 0) {
+      packed[k] = buffer & 0xFF;
+    }
+  }
+
+  return res;
+}
+
+/**
+ * Desserializa uma path list serializada pela função
+ * serialize_path_list
+ *
+ * @param spl a path list serializada
+ * @param num_paths o número de caminhos em spl
+ * @param n o número de nós no grafo
  * @return path_list*
  */
-path_list *deserialize_path_list(int *spl, int spl_size, int path_size) {
+path_list *deserialize_path_list(unsigned char *spl, int num_paths, int n) {
   path_list *pl = new_path_list();
-  int num_paths = spl_size / path_size;
+  int bits = get_node_bits(n);
+  int packed_size = get_packed_path_size(n);
+  unsigned long long mask = (1ull << bits) - 1;
+
+  for (int i = 0; i < num_paths; i++) {
+    unsigned char *packed = spl + ((size_t)packed_size * i);
+    unsigned long long buffer = 0; // Bits ainda não lidos
+    int buffered = 0;              // Número de bits em buffer
+    int k = 0;
+
+    path *p = new_path();
+    p->size = n + 1;
+    p->nodes[0] = STARTING_NODE;
+    p->nodes[n] = STARTING_NODE;
+    for (int j = 1; j < n; j++) {
+      while (buffered < bits) {
+        buffer |= (unsigned long long)packed[k++] << buffered;
+        buffered += 8;
+      }
+      p->nodes[j] = buffer & mask;
+      buffer >>= bits;
+      buffered -= bits;
+    }
+    concatenate_to_path_list(pl, p);
+  }
+
+  return pl;
+}
+
+/**
+ * Junta duas path lists em uma, mantendo apenas os caminhos de menor custo.
+ * Os caminhos de other são copiados para dest, até o limite de dest, e o
+ * arquivo de other é copiado para o de dest.
+ *
+ * @param dest uma das path lists, onde o resultado ficará armazenado
+ * @param other a outra path list, que não é modificada
+ *
+ * @returns void
+ */
+void merge_path_lists(path_list *dest, path_list *other) {
+  if (other->count == 0 || (dest->count > 0 && other->cost > dest->cost)) {
+    return;
+  }
+
+  if (dest->count > 0 && other->cost < dest->cost) {
+    reset_path_list(dest);
+  }
+
+  dest->cost = other->cost;
+  dest->count += other->count;
+  for (int i = 0; i < other->size; i++) {
+    store_path(dest, other->paths[i]);
+  }
+
+  if (dest->stream != NULL && other->stream != NULL) {
+    copy_stream(dest->stream, other->stream);
+  }
+}
+
+/*
+*********** Utilidades para o Held-Karp **********
+*/
+
+/**
+ * Obtém o nó do grafo correspondente ao bit j das máscaras do Held-Karp.
+ * As máscaras representam apenas os nós diferentes de STARTING_NODE.
+ *
+ * @param j o índice do bit
+ *
+ * @returns o nó correspondente
+ */
+int held_karp_node(int j) { return (j < STARTING_NODE) ? j : j + 1; }
+
+/**
+ * Preenche a tabela de coeficientes binomiais utilizada para numerar os
+ * subconjuntos de cada camada do Held-Karp
+ *
+ * @returns void
+ */
+void fill_binomials() {
+  for (int i = 0; i <= HELD_KARP_MAX_SIZE; i++) {
+    binomials[i][0] = 1;
+    for (int j = 1; j <= i; j++) {
+      binomials[i][j] = binomials[i - 1][j - 1] + binomials[i - 1][j];
+    }
+  }
+}
+
+/**
+ * Obtém a posição de um subconjunto entre todos os subconjuntos de mesmo
+ * tamanho, em ordem crescente (ordem colexicográfica)
+ *
+ * @param mask o subconjunto
+ *
+ * @returns a posição de mask na sua camada
+ */
+long long get_subset_index(unsigned int mask) {
+  long long index = 0;
+  for (int i = 1; mask != 0; i++) {
+    int bit = __builtin_ctz(mask);
+    index += binomials[bit][i];
+    mask &= mask - 1;
+  }
+
+  return index;
+}
+
+/**
+ * Obtém o subconjunto de tamanho k em uma dada posição da sua camada.
+ * É o inverso de get_subset_index.
+ *
+ * @param index a posição do subconjunto na camada
+ * @param k o tamanho do subconjunto
+ *
+ * @returns o subconjunto
+ */
+unsigned int get_subset_at(long long index, int k) {
+  unsigned int mask = 0;
+  for (int i = k; i > 0; i--) {
+    int bit = i - 1;
+    while (binomials[bit + 1][i] <= index) {
+      bit++;
+    }
+    mask |= 1u << bit;
+    index -= binomials[bit][i];
+  }
+
+  return mask;
+}
+
+/**
+ * Obtém o próximo subconjunto de mesmo tamanho em ordem crescente
+ *
+ * @param mask o subconjunto atual
+ *
+ * @returns o próximo subconjunto
+ */
+unsigned int get_next_subset(unsigned int mask) {
+  unsigned int lowest = mask & -mask;
+  unsigned int ripple = mask + lowest;
+  return (((ripple ^ mask) >> 2) / lowest) | ripple;
+}
+
+/**
+ * Calcula o bloco de elementos de uma lista com total elementos
+ * que pertence a um processo
+ *
+ * @param first um ponteiro para a variável que armazenará o primeiro índice
+ * @param count um ponteiro para a variável que armazenará o número de índices
+ * @param total o número de elementos na lista
+ * @param world_size o número de processos
+ * @param rank o rank do processo
+ *
+ * @returns void
+ */
+void get_block_range(long long *first, long long *count, long long total,
+                     int world_size, int rank) {
+  *first = (total * rank) / world_size;
+  *count = ((total * (rank + 1)) / world_size) - *first;
+}
+
+/**
+ * Obtém o processo ao qual pertence um elemento de uma lista dividida
+ * com get_block_range
+ *
+ * @param index o índice do elemento
+ * @param total o número de elementos na lista
+ * @param world_size o número de processos
+ *
+ * @returns o rank do processo
+ */
+int get_block_owner(long long index, long long total, int world_size) {
+  return (int)(((index + 1) * world_size - 1) / total);
+}
+
+/**
+ * Compara dois subconjuntos, para a busca com bsearch
+ */
+int compare_masks(const void *a, const void *b) {
+  unsigned int x = *(const unsigned int *)a;
+  unsigned int y = *(const unsigned int *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Compara dois estados do Held-Karp pelo subconjunto e pelo último nó,
+ * para ordenação com qsort
+ */
+int compare_held_karp_states(const void *a, const void *b) {
+  const held_karp_state *x = (const held_karp_state *)a;
+  const held_karp_state *y = (const held_karp_state *)b;
+  if (x->mask != y->mask) {
+    return (x->mask > y->mask) - (x->mask < y->mask);
+  }
+
+  return x->last - y->last;
+}
+
+/**
+ * Aloca um vetor usado no cálculo de uma camada do Held-Karp. Se não houver
+ * memória, aborta a execução.
+ *
+ * @param size o tamanho do vetor, em bytes
+ * @param k o tamanho dos subconjuntos da camada
+ *
+ * @returns o vetor alocado
+ */
+void *alloc_held_karp_buffer(size_t size, int k) {
+  void *buffer = malloc(size);
+  if (size > 0 && buffer == NULL) {
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    printf("O processo %d não tem memória suficiente para a camada %d do "
+           "Held-Karp.\n",
+           rank, k);
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+
+  return buffer;
+}
+
+/**
+ * Aloca a parte de uma camada do Held-Karp que pertence a este processo e
+ * preenche os seus subconjuntos. Se não houver memória, aborta a execução.
+ *
+ * @param m o número de bits das máscaras (n - 1)
+ * @param k o tamanho dos subconjuntos da camada
+ * @param world_size o número de processos
+ * @param rank o rank do processo
+ *
+ * @returns a camada alocada, com os custos ainda não calculados
+ */
+held_karp_layer *new_held_karp_layer(int m, int k, int world_size, int rank) {
+  held_karp_layer *layer = (held_karp_layer *)malloc(sizeof(held_karp_layer));
+  layer->size = k;
+  layer->total = binomials[m][k];
+  get_block_range(&layer->first, &layer->count, layer->total, world_size,
+                  rank);
+
+  layer->masks = (unsigned int *)alloc_held_karp_buffer(
+      layer->count * sizeof(unsigned int), k);
+  layer->costs =
+      (int *)alloc_held_karp_buffer(layer->count * k * sizeof(int), k);
+
+  if (layer->count > 0) {
+    layer->masks[0] = get_subset_at(layer->first, k);
+    for (long long i = 1; i < layer->count; i++) {
+      layer->masks[i] = get_next_subset(layer->masks[i - 1]);
+    }
+  }
+
+  return layer;
+}
+
+/**
+ * Libera o espaço de uma camada do Held-Karp
+ *
+ * @param layer a camada a ser liberada
+ *
+ * @returns void
+ */
+void delete_held_karp_layer(held_karp_layer *layer) {
+  free(layer->masks);
+  free(layer->costs);
+  free(layer);
+}
+
+/**
+ * Calcula os custos da primeira camada do Held-Karp, formada pelos
+ * caminhos STARTING_NODE -> nó
+ *
+ * @param layer a camada
+ * @param adj a matriz de adjacências do grafo
+ *
+ * @returns void
+ */
+void compute_first_held_karp_layer(held_karp_layer *layer, cost_matrix *adj) {
+  for (long long i = 0; i < layer->count; i++) {
+    int node = held_karp_node(__builtin_ctz(layer->masks[i]));
+    int edge = EDGE_COST(adj, STARTING_NODE, node);
+    layer->costs[i] = (edge == MAX_COST) ? COST_INFINITE : edge;
+  }
+}
+
+/**
+ * Calcula os custos de uma camada do Held-Karp a partir da camada anterior.
+ * Cada processo pede aos donos da camada anterior apenas as entradas dos
+ * subconjuntos dos quais os seus subconjuntos dependem, e então calcula a
+ * sua parte da camada com as threads disponíveis. Se não houver memória,
+ * aborta a execução.
+ *
+ * @param layer a camada a ser calculada
+ * @param previous a camada anterior
+ * @param adj a matriz de adjacências do grafo
+ * @param world_size o número de processos
+ *
+ * @returns void
+ */
+void compute_held_karp_layer(held_karp_layer *layer, held_karp_layer *previous,
+                             cost_matrix *adj, int world_size) {
+  int k = layer->size;
+
+  /* Subconjuntos da camada anterior necessários para esse processo, marcados
+  em um mapa de bits indexado pela posição na camada. Cada subconjunto é
+  necessário para até k subconjuntos da camada, então o mapa ocupa bem menos
+  que a lista de todos os antecessores, com repetições. */
+  long long words = (previous->total + MAP_WORD_BITS - 1) / MAP_WORD_BITS;
+  unsigned long long *marked = (unsigned long long *)alloc_held_karp_buffer(
+      words * sizeof(unsigned long long), k);
+  memset(marked, 0, words * sizeof(unsigned long long));
+
+#pragma omp parallel for num_threads(THREADS) schedule(static)
+  for (long long i = 0; i < layer->count; i++) {
+    for (unsigned int bits = layer->masks[i]; bits != 0; bits &= bits - 1) {
+      long long index = get_subset_index(layer->masks[i] & ~(bits & -bits));
+      __atomic_fetch_or(&marked[index / MAP_WORD_BITS],
+                        1ull << (index % MAP_WORD_BITS), __ATOMIC_RELAXED);
+    }
+  }
+
+  long long needed_count = 0;
+  for (long long w = 0; w < words; w++) {
+    needed_count += __builtin_popcountll(marked[w]);
+  }
+
+  /* Como a ordem crescente dos subconjuntos é a mesma da sua posição na
+  camada, os pedidos já saem ordenados e agrupados por processo dono */
+  unsigned int *needed = (unsigned int *)alloc_held_karp_buffer(
+      needed_count * sizeof(unsigned int), k);
+  int *send_counts = (int *)calloc(world_size, sizeof(int));
+  int *send_displacements = (int *)malloc(world_size * sizeof(int));
+  int *recv_counts = (int *)malloc(world_size * sizeof(int));
+  int *recv_displacements = (int *)malloc(world_size * sizeof(int));
+  long long filled = 0;
+  long long last_index = -1;
+  for (long long w = 0; w < words; w++) {
+    for (unsigned long long bits = marked[w]; bits != 0; bits &= bits - 1) {
+      long long index = (w * MAP_WORD_BITS) + __builtin_ctzll(bits);
+      needed[filled] = (filled > 0 && index == last_index + 1)
+                           ? get_next_subset(needed[filled - 1])
+                           : get_subset_at(index, k - 1);
+      filled++;
+      last_index = index;
+      send_counts[get_block_owner(index, previous->total, world_size)]++;
+    }
+  }
+  free(marked);
+
+  MPI_Alltoall(send_counts, 1, MPI_INT, recv_counts, 1, MPI_INT,
+               MPI_COMM_WORLD);
+
+  long long requested_count = 0;
+  for (int i = 0; i < world_size; i++) {
+    send_displacements[i] =
+        (i == 0) ? 0 : send_displacements[i - 1] + send_counts[i - 1];
+    recv_displacements[i] =
+        (i == 0) ? 0 : recv_displacements[i - 1] + recv_counts[i - 1];
+    requested_count += recv_counts[i];
+  }
+
+  /* As contagens e deslocamentos do MPI são ints, então são medidos em
+  subconjuntos, e não em custos */
+  if (needed_count > __INT_MAX__ || requested_count > __INT_MAX__) {
+    printf("A camada %d do Held-Karp tem subconjuntos demais para serem "
+           "trocados entre os processos. Execute o programa com mais "
+           "processos.\n",
+           k);
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+
+  unsigned int *requested = (unsigned int *)alloc_held_karp_buffer(
+      requested_count * sizeof(unsigned int), k);
+  MPI_Alltoallv(needed, send_counts, send_displacements, MPI_UNSIGNED,
+                requested, recv_counts, recv_displacements, MPI_UNSIGNED,
+                MPI_COMM_WORLD);
+
+  // Responde com os custos dos subconjuntos pedidos por outros processos
+  size_t row_size = k - 1;
+  int *replies = (int *)alloc_held_karp_buffer(
+      requested_count * row_size * sizeof(int), k);
+  for (long long i = 0; i < requested_count; i++) {
+    long long local = get_subset_index(requested[i]) - previous->first;
+    memcpy(replies + (i * row_size), previous->costs + (local * row_size),
+           row_size * sizeof(int));
+  }
+
+  // Cada linha de custos de um subconjunto é trocada como um só elemento
+  MPI_Datatype row_type;
+  MPI_Type_contiguous((int)row_size, MPI_INT, &row_type);
+  MPI_Type_commit(&row_type);
+
+  int *needed_costs = (int *)alloc_held_karp_buffer(
+      needed_count * row_size * sizeof(int), k);
+  MPI_Alltoallv(replies, recv_counts, recv_displacements, row_type,
+                needed_costs, send_counts, send_displacements, row_type,
+                MPI_COMM_WORLD);
+
+  MPI_Type_free(&row_type);
+
+  free(requested);
+  free(replies);
+  free(send_counts);
+  free(send_displacements);
+  free(recv_counts);
+  free(recv_displacements);
+
+#pragma omp parallel for num_threads(THREADS) schedule(static)
+  for (long long i = 0; i < layer->count; i++) {
+    unsigned int mask = layer->masks[i];
+    int *row = layer->costs + (i * k);
+    int position = 0;
+
+    for (unsigned int bits = mask; bits != 0; bits &= bits - 1) {
+      int node = held_karp_node(__builtin_ctz(bits));
+      unsigned int previous_mask = mask & ~(bits & -bits);
+      unsigned int *found =
+          (unsigned int *)bsearch(&previous_mask, needed, needed_count,
+                                  sizeof(unsigned int), compare_masks);
+      int *previous_row = needed_costs + ((found - needed) * row_size);
+
+      int cost = COST_INFINITE;
+      int q = 0;
+      for (unsigned int p = previous_mask; p != 0; p &= p - 1, q++) {
+        int edge = EDGE_COST(adj, held_karp_node(__builtin_ctz(p)), node);
+        if (previous_row[q] != COST_INFINITE && edge != MAX_COST &&
+            previous_row[q] + edge < cost) {
+          cost = previous_row[q] + edge;
+        }
+      }
+
+      row[position++] = cost;
+    }
+  }
+
+  free(needed);
+  free(needed_costs);
+}
+
+/**
+ * Junta os estados ótimos encontrados por cada processo em uma camada,
+ * de forma que todos os processos conheçam todos eles
+ *
+ * @param local os estados encontrados por esse processo, em ordem crescente
+ * @param local_count o número de estados em local
+ * @param count um ponteiro para a variável que armazenará o número total de
+ * estados
+ * @param world_size o número de processos
+ *
+ * @returns os estados de todos os processos, em ordem crescente
+ */
+held_karp_state *gather_held_karp_states(held_karp_state *local,
+                                         int local_count, int *count,
+                                         int world_size) {
+  int *counts = (int *)malloc(world_size * sizeof(int));
+  int *displacements = (int *)malloc(world_size * sizeof(int));
+  int local_size = local_count * 3; // Cada estado é enviado como 3 ints
+
+  MPI_Allgather(&local_size, 1, MPI_INT, counts, 1, MPI_INT, MPI_COMM_WORLD);
+
+  int total = 0;
+  for (int i = 0; i < world_size; i++) {
+    displacements[i] = total;
+    total += counts[i];
+  }
+
+  /* Cada processo é dono de um bloco contíguo da camada, então a
+  concatenação dos estados continua em ordem crescente */
+  held_karp_state *states = (held_karp_state *)malloc(
+      (total / 3) * sizeof(held_karp_state) + sizeof(held_karp_state));
+  MPI_Allgatherv(local, local_size, MPI_INT, states, counts, displacements,
+                 MPI_INT, MPI_COMM_WORLD);
+
+  free(counts);
+  free(displacements);
+
+  *count = total / 3;
+  return states;
+}
+
+/**
+ * Obtém os estados da camada anterior que levam com custo mínimo aos estados
+ * de frontier. Cada processo verifica apenas os estados que possui.
+ *
+ * @param frontier os estados ótimos da camada atual
+ * @param frontier_count o número de estados em frontier
+ * @param previous a camada anterior
+ * @param adj a matriz de adjacências do grafo
+ * @param count um ponteiro para a variável que armazenará o número de estados
+ * @param world_size o número de processos
+ *
+ * @returns os estados ótimos da camada anterior, de todos os processos
+ */
+held_karp_state *get_previous_held_karp_states(held_karp_state *frontier,
+                                               int frontier_count,
+                                               held_karp_layer *previous,
+                                               cost_matrix *adj, int *count,
+                                               int world_size) {
+  int row_size = previous->size;
+  int local_count = 0;
+  int local_capacity = PATH_LIST_SIZE;
+  held_karp_state *local =
+      (held_karp_state *)malloc(local_capacity * sizeof(held_karp_state));
+
+  for (int i = 0; i < frontier_count; i++) {
+    held_karp_state *s = &frontier[i];
+    unsigned int previous_mask = s->mask & ~(1u << s->last);
+    long long index = get_subset_index(previous_mask);
+    if (index < previous->first ||
+        index >= previous->first + previous->count) {
+      continue; // O estado anterior pertence a outro processo
+    }
+
+    int *row = previous->costs + ((index - previous->first) * row_size);
+    int node = held_karp_node(s->last);
+    int q = 0;
+    for (unsigned int p = previous_mask; p != 0; p &= p - 1, q++) {
+      int bit = __builtin_ctz(p);
+      int edge = EDGE_COST(adj, held_karp_node(bit), node);
+      if (row[q] == COST_INFINITE || edge == MAX_COST ||
+          row[q] + edge != s->cost) {
+        continue;
+      }
+
+      if (local_count == local_capacity) {
+        local_capacity *= 2;
+        local = (held_karp_state *)realloc(
+            local, local_capacity * sizeof(held_karp_state));
+      }
+      local[local_count].mask = previous_mask;
+      local[local_count].last = bit;
+      local[local_count].cost = row[q];
+      local_count++;
+    }
+  }
+
+  // Remove os estados repetidos, alcançados por mais de um estado de frontier
+  qsort(local, local_count, sizeof(held_karp_state), compare_held_karp_states);
+  int unique_count = 0;
+  for (int i = 0; i < local_count; i++) {
+    if (unique_count == 0 ||
+        compare_held_karp_states(&local[i], &local[unique_count - 1]) != 0) {
+      local[unique_count++] = local[i];
+    }
+  }
+
+  held_karp_state *res =
+      gather_held_karp_states(local, unique_count, count, world_size);
+  free(local);
+  return res;
+}
+
+/**
+ * Reconstrói todos os caminhos ótimos que passam pelo estado s, da camada k,
+ * preenchendo p de trás para frente a partir dos estados ótimos de cada
+ * camada.
+ *
+ * @param states os estados ótimos de cada camada
+ * @param counts o número de estados ótimos em cada camada
+ * @param adj a matriz de adjacências do grafo
+ * @param s o estado atual
+ * @param k a camada de s
+ * @param p o caminho sendo reconstruído
+ * @param res a path list onde são registrados os caminhos reconstruídos
+ *
+ * @returns void
+ */
+void held_karp_collect(held_karp_state **states, int *counts, cost_matrix *adj,
+                       held_karp_state *s, int k, path *p, path_list *res) {
+  int node = held_karp_node(s->last);
+  p->nodes[k] = node;
+
+  if (k == 1) {
+    add_to_path_list(res, p, p->cost);
+    return;
+  }
+
+  // Busca o primeiro estado da camada anterior com o subconjunto anterior
+  unsigned int previous_mask = s->mask & ~(1u << s->last);
+  held_karp_state *previous = states[k - 1];
+  int low = 0, high = counts[k - 1];
+  while (low < high) {
+    int middle = (low + high) / 2;
+    if (previous[middle].mask < previous_mask) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+
+  for (int i = low; i < counts[k - 1] && previous[i].mask == previous_mask;
+       i++) {
+    int edge = EDGE_COST(adj, held_karp_node(previous[i].last), node);
+    if (edge != MAX_COST && previous[i].cost + edge == s->cost) {
+      held_karp_collect(states, counts, adj, &previous[i], k - 1, p, res);
+    }
+  }
+}
+
+/*
+************* Utilidades para tarefas ************
+*/
+
+/**
+ * Preenche a lista de tarefas com todos os prefixos que começam com os
+ * size nós de prefix, em ordem lexicográfica
+ *
+ * @param q a fila de tarefas
+ * @param prefix o prefixo atual, sem STARTING_NODE
+ * @param size o número de nós em prefix
+ * @param n o número de nós no grafo
+ *
+ * @returns void
+ */
+void fill_tasks(task_queue *q, int *prefix, int size, int n) {
+  if (size == q->depth) {
+    memcpy(q->tasks + (q->count * q->depth), prefix, size * sizeof(int));
+    q->count++;
+    return;
+  }
+
+  for (int i = 0; i < n; i++) {
+    int used = (i == STARTING_NODE);
+    for (int j = 0; j < size && !used; j++) {
+      used = (prefix[j] == i);
+    }
+
+    if (!used) {
+      prefix[size] = i;
+      fill_tasks(q, prefix, size + 1, n);
+    }
+  }
+}
+
+/**
+ * Calcula o número de tarefas da busca em profundidade, (n - 1)! /
+ * (n - 1 - depth)!, com depth limitado a n - 1. O cálculo para assim que o
+ * número passa de MAX_TASKS, para não estourar.
+ *
+ * @param n o número de nós no grafo
+ * @param depth o número de nós após STARTING_NODE em cada prefixo
+ *
+ * @returns o número de tarefas, ou um número maior que MAX_TASKS se elas
+ * passam do limite
+ */
+long long get_task_count(int n, int depth) {
+  long long total = 1;
+  for (int i = 0; i < depth && i < n - 1 && total <= MAX_TASKS; i++) {
+    total *= (n - 1 - i);
+  }
+
+  return total;
+}
+
+/**
+ * Cria a fila de tarefas de um processo. Uma tarefa é a subárvore da busca
+ * abaixo de um prefixo com depth nós após STARTING_NODE. Todos os processos
+ * geram a mesma lista, então uma tarefa é identificada apenas pelo seu
+ * índice.
+ *
+ * @param n o número de nós no grafo
+ * @param depth o número de nós após STARTING_NODE em cada prefixo
+ * @param rank o rank do processo
+ *
+ * @returns a fila de tarefas alocada dinamicamente
+ */
+task_queue *new_task_queue(int n, int depth, int rank) {
+  task_queue *q = (task_queue *)malloc(1 * sizeof(task_queue));
+  q->depth = (depth < n - 1) ? depth : n - 1;
+  if (q->depth < 0) {
+    q->depth = 0;
+  }
+
+  // O número de tarefas já foi verificado contra MAX_TASKS
+  long long total = get_task_count(n, q->depth);
+  q->tasks = (int *)malloc((total * q->depth + 1) * sizeof(int));
+  if (q->tasks == NULL) {
+    printf("O processo %d não tem memória suficiente para as %lld tarefas "
+           "da busca.\n",
+           rank, total);
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  q->count = 0;
+  q->next = 0;
+  q->exhausted = 0;
+  q->rank = rank;
+  q->finished = NULL;
+  q->checkpoint = NULL;
+  q->synced_at = 0;
+
+  int *prefix = (int *)malloc((q->depth + 1) * sizeof(int));
+  fill_tasks(q, prefix, 0, n);
+  free(prefix);
+
+  return q;
+}
+
+/**
+ * Libera o espaço de uma fila de tarefas
+ *
+ * @param q a fila a ser liberada
+ *
+ * @returns void
+ */
+void delete_task_queue(task_queue *q) {
+  free(q->tasks);
+  free(q->finished);
+  free(q);
+  q = NULL;
+}
+
+/**
+ * Lê o melhor custo conhecido, que pode estar sendo atualizado por outras
+ * threads ao mesmo tempo. A leitura não precisa de trava nem de barreira de
+ * memória: um valor desatualizado apenas poda menos.
+ *
+ * @param best_cost o melhor custo conhecido
+ *
+ * @returns o valor atual de best_cost
+ */
+int get_best_cost(int *best_cost) {
+  return __atomic_load_n(best_cost, __ATOMIC_RELAXED);
+}
+
+/**
+ * Atualiza o melhor custo conhecido com compare-and-swap, caso cost seja
+ * menor que ele. Se outra thread atualizar o custo ao mesmo tempo, a
+ * comparação é refeita com o novo valor.
+ *
+ * @param best_cost o melhor custo conhecido
+ * @param cost o custo de um caminho completo
+ *
+ * @returns void
+ */
+void update_best_cost(int *best_cost, int cost) {
+  int current = get_best_cost(best_cost);
+  while (cost < current &&
+         !__atomic_compare_exchange_n(best_cost, &current, cost, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+  }
+}
+
+/**
+ * Obtém o índice da próxima tarefa a ser resolvida pela thread que chama a
+ * função. Na manager, as tarefas são retiradas diretamente da fila; nos
+ * workers, são pedidas à manager. Cada pedido leva o melhor custo conhecido
+ * pelo processo, e a resposta traz o melhor custo conhecido pela manager,
+ * para que todos os processos podem os ramos com o melhor custo global.
+ *
+ * @param q a fila de tarefas
+ * @param best_cost o melhor custo conhecido pelo processo
+ *
+ * @returns o índice da tarefa, ou NO_TASK se não há mais tarefas
+ */
+int get_next_task(task_queue *q, int *best_cost) {
+  int task;
+
+  if (q->rank == MANAGER_PROCESS_RANK) {
+    // As tarefas resolvidas em uma execução anterior são puladas
+    do {
+#pragma omp atomic capture
+      task = q->next++;
+    } while (task < q->count && q->finished != NULL && q->finished[task]);
+
+    return (task < q->count) ? task : NO_TASK;
+  }
+
+#pragma omp critical(task_queue)
+  {
+    task = NO_TASK;
+    if (!q->exhausted) {
+      int request = get_best_cost(best_cost);
+      int reply[2]; // A tarefa e o melhor custo conhecido pela manager
+      MPI_Send(&request, 1, MPI_INT, MANAGER_PROCESS_RANK, TAG_TASK_REQUEST,
+               MPI_COMM_WORLD);
+      MPI_Recv(reply, 2, MPI_INT, MANAGER_PROCESS_RANK, TAG_TASK,
+               MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+      task = reply[0];
+      update_best_cost(best_cost, reply[1]);
+      q->exhausted = (task == NO_TASK);
+    }
+  }
+
+  return task;
+}
+
+/**
+ * Atende os pedidos de tarefas dos workers, até que todos tenham sido
+ * avisados de que não há mais tarefas. Executada por uma thread da manager.
+ * O melhor custo enviado em cada pedido atualiza o da manager, que é
+ * devolvido junto à tarefa.
+ *
+ * @param q a fila de tarefas da manager
+ * @param world_size o número de processos
+ * @param best_cost o melhor custo conhecido pela manager
+ *
+ * @returns void
+ */
+void serve_task_requests(task_queue *q, int world_size, int *best_cost) {
+  int finished_workers = 0;
+
+  while (finished_workers < world_size - 1) {
+    int request;
+    MPI_Status status;
+    MPI_Recv(&request, 1, MPI_INT, MPI_ANY_SOURCE, TAG_TASK_REQUEST,
+             MPI_COMM_WORLD, &status);
+    update_best_cost(best_cost, request);
+
+    int reply[2];
+    reply[0] = get_next_task(q, best_cost);
+    reply[1] = get_best_cost(best_cost);
+    if (reply[0] == NO_TASK) {
+      finished_workers++;
+    }
+
+    MPI_Send(reply, 2, MPI_INT, status.MPI_SOURCE, TAG_TASK, MPI_COMM_WORLD);
+  }
+}
+
+/*
+****** Utilidades para medição de desempenho ******
+*/
+
+/**
+ * Obtém o tempo atual de um relógio monotônico, para medir intervalos
+ *
+ * @returns o tempo atual, em segundos
+ */
+double get_time() {
+  return MPI_Wtime();
+}
+
+/**
+ * Imprime na saída de erro, em uma linha JSON, o tempo gasto em cada fase da
+ * execução e o total, para que os tempos possam ser lidos por scripts
+ *
+ * @param n o número de nós no grafo
+ * @param seed a semente da matriz aleatória
+ * @param ranks o número de processos
+ * @param threads o número de threads por processo
+ *
+ * @returns void
+ */
+void print_phase_times(int n, int seed, int ranks, int threads) {
+  double total = 0;
+  fflush(stdout);
+
+  fprintf(stderr,
+          "{\"n\": %d, \"seed\": %d, \"ranks\": %d, \"threads\": %d", n,
+          seed, ranks, threads);
+  for (int i = 0; i < PHASES; i++) {
+    fprintf(stderr, ", \"%s\": %.6f", phase_names[i], phase_times[i]);
+    total += phase_times[i];
+  }
+  fprintf(stderr, ", \"total\": %.6f}\n", total);
+}
+
+/**
+ * Imprime na saída de erro uma linha da tabela de contadores da busca
+ *
+ * @param rank o rótulo da coluna do processo
+ * @param thread o rótulo da coluna da thread
+ * @param counters os contadores
+ *
+ * @returns void
+ */
+void print_counters_row(const char *rank, const char *thread,
+                        long long *counters) {
+  fprintf(stderr, "%6s %7s", rank, thread);
+  for (int i = 0; i < COUNTERS; i++) {
+    fprintf(stderr, " %12lld", counters[i]);
+  }
+  fprintf(stderr, "\n");
+}
+
+/**
+ * Imprime na saída de erro quantos ramos a busca considerou e a fração deles
+ * que foi podada ou descartada por arestas inexistentes
+ *
+ * @param counters os contadores de toda a busca
+ *
+ * @returns void
+ */
+void print_branch_summary(long long *counters) {
+  long long branches = counters[COUNTER_EXPANDED] +
+                       counters[COUNTER_INFEASIBLE] + counters[COUNTER_PRUNED];
+  double total = (branches > 0) ? branches : 1;
+  fprintf(stderr,
+          "Ramos considerados: %lld, dos quais %.2f%% podados e %.2f%% "
+          "inviáveis\n",
+          branches, 100.0 * counters[COUNTER_PRUNED] / total,
+          100.0 * counters[COUNTER_INFEASIBLE] / total);
+}
+
+/**
+ * Junta na manager os contadores da busca de todas as threads de todos os
+ * processos, junto dos bytes e do tempo de cada processo na coleta das
+ * respostas, e os imprime na saída de erro, com um resumo do desbalanceamento
+ * entre os processos e entre as threads. Todos os processos devem chamar essa
+ * função.
+ *
+ * @param threads o número de threads do processo
+ * @param world_size o número de processos
+ * @param rank o rank do processo
+ *
+ * @returns void
+ */
+void report_search_counters(int threads, int world_size, int rank) {
+  // Os bytes enviados, os bytes recebidos e o tempo na coleta das respostas
+  double gather[3] = {(double)gather_bytes_sent, (double)gather_bytes_received,
+                      phase_times[PHASE_GATHER]};
+  int *thread_counts = NULL;
+  double *gathers = NULL;
+  if (rank == MANAGER_PROCESS_RANK) {
+    thread_counts = (int *)malloc(world_size * sizeof(int));
+    gathers = (double *)malloc(3 * world_size * sizeof(double));
+  }
+  MPI_Gather(&threads, 1, MPI_INT, thread_counts, 1, MPI_INT,
+             MANAGER_PROCESS_RANK, MPI_COMM_WORLD);
+  MPI_Gather(gather, 3, MPI_DOUBLE, gathers, 3, MPI_DOUBLE,
+             MANAGER_PROCESS_RANK, MPI_COMM_WORLD);
+
+  int *counts = NULL;
+  int *displacements = NULL;
+  long long *counters = NULL;
+  if (rank == MANAGER_PROCESS_RANK) {
+    counts = (int *)malloc(world_size * sizeof(int));
+    displacements = (int *)malloc(world_size * sizeof(int));
+    int total_count = 0;
+    for (int r = 0; r < world_size; r++) {
+      counts[r] = thread_counts[r] * COUNTERS;
+      displacements[r] = total_count;
+      total_count += counts[r];
+    }
+    counters = (long long *)malloc((total_count + 1) * sizeof(long long));
+  }
+  MPI_Gatherv(search_counters, threads * COUNTERS, MPI_LONG_LONG, counters,
+              counts, displacements, MPI_LONG_LONG, MANAGER_PROCESS_RANK,
+              MPI_COMM_WORLD);
+
+  if (rank != MANAGER_PROCESS_RANK) {
+    return;
+  }
+
+  fflush(stdout);
+  fprintf(stderr, "Contadores da busca:\n" COUNTERS_HEADER "\n");
+
+  long long total[COUNTERS] = {0};
+  long long max_rank = 0, max_thread = 0, sum_threads = 0;
+  int working_threads = 0;
+  char rank_label[16], thread_label[16];
+  for (int r = 0; r < world_size; r++) {
+    long long rank_total[COUNTERS] = {0};
+    snprintf(rank_label, sizeof(rank_label), "%d", r);
+
+    for (int t = 0; t < thread_counts[r]; t++) {
+      long long *row = counters + displacements[r] + (t * COUNTERS);
+      snprintf(thread_label, sizeof(thread_label), "%d", t);
+      print_counters_row(rank_label, thread_label, row);
+      for (int i = 0; i < COUNTERS; i++) {
+        rank_total[i] += row[i];
+      }
+
+      // A thread que só distribui as tarefas não entra no desbalanceamento
+      if (r != MANAGER_PROCESS_RANK || t != 0 || world_size == 1) {
+        long long expanded = row[COUNTER_EXPANDED];
+        max_thread = (expanded > max_thread) ? expanded : max_thread;
+        sum_threads += expanded;
+        working_threads++;
+      }
+    }
+
+    print_counters_row(rank_label, "total", rank_total);
+    for (int i = 0; i < COUNTERS; i++) {
+      total[i] += rank_total[i];
+    }
+    if (rank_total[COUNTER_EXPANDED] > max_rank) {
+      max_rank = rank_total[COUNTER_EXPANDED];
+    }
+  }
+  print_counters_row("total", "", total);
+
+  fprintf(stderr, "\nColeta das respostas:\n"
+                  "  rank  bytes enviados  bytes recebidos  tempo (s)\n");
+  for (int r = 0; r < world_size; r++) {
+    fprintf(stderr, "%6d %15.0f %16.0f %10.6f\n", r, gathers[3 * r],
+            gathers[3 * r + 1], gathers[3 * r + 2]);
+  }
+
+  double mean_rank = (double)total[COUNTER_EXPANDED] / world_size;
+  double mean_thread =
+      (working_threads > 0) ? (double)sum_threads / working_threads : 0;
+  fprintf(stderr,
+          "\nDesbalanceamento (máximo / média dos nós expandidos): %.3f entre "
+          "os processos, %.3f entre as threads\n",
+          (mean_rank > 0) ? max_rank / mean_rank : 1.0,
+          (mean_thread > 0) ? max_thread / mean_thread : 1.0);
+  print_branch_summary(total);
+
+  free(thread_counts);
+  free(gathers);
+  free(counts);
+  free(displacements);
+  free(counters);
+}
+
+/*
+***** Utilidades para o limitante inferior *****
+*/
+
+/**
+ * Cria os limitantes inferiores de um grafo. Como o grafo é direcionado, a
+ * 1-tree usa o menor custo entre os dois sentidos de cada aresta.
+ *
+ * @param adj a matriz de adjacências do grafo
+ *
+ * @returns os limitantes, sem nenhuma designação resolvida e com todas as
+ * penalidades nulas
+ */
+lower_bound *new_lower_bound(cost_matrix *adj) {
+  int n = adj->n;
+  lower_bound *b = (lower_bound *)malloc(sizeof(lower_bound));
+  b->n = n;
+  b->assignments = (assignment *)malloc((n + 1) * sizeof(assignment));
+  int *data = (int *)malloc((n + 1) * (4 * n + 2) * sizeof(int));
+  for (int size = 0; size <= n; size++) {
+    assignment *a = &b->assignments[size];
+    a->successors = data + (size * (4 * n + 2));
+    a->predecessors = a->successors + n;
+    a->row_potentials = a->predecessors + (n + 1);
+    a->column_potentials = a->row_potentials + n;
+    a->solved = 0;
+  }
+  b->columns = (int *)malloc((n + 1) * sizeof(int));
+  b->slacks = (int *)malloc((n + 1) * sizeof(int));
+  b->ways = (int *)malloc((n + 1) * sizeof(int));
+  b->used = (int *)malloc((n + 1) * sizeof(int));
+  b->costs = (int *)malloc(n * n * sizeof(int));
+  b->penalties = (double *)calloc(n, sizeof(double));
+  b->nodes = (int *)malloc(n * sizeof(int));
+  b->parents = (int *)malloc(n * sizeof(int));
+  b->degrees = (int *)malloc(n * sizeof(int));
+  b->distances = (double *)malloc(n * sizeof(double));
+
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < n; j++) {
+      int forward = EDGE_COST(adj, i, j), backward = EDGE_COST(adj, j, i);
+      int cost = (forward < backward) ? forward : backward;
+      b->costs[i * n + j] = (cost == MAX_COST) ? COST_INFINITE : cost;
+    }
+  }
+
+  return b;
+}
+
+/**
+ * Libera o limitante criado por new_lower_bound
+ *
+ * @param b o limitante
+ *
+ * @returns void
+ */
+void delete_lower_bound(lower_bound *b) {
+  free(b->assignments[0].successors);
+  free(b->assignments);
+  free(b->columns);
+  free(b->slacks);
+  free(b->ways);
+  free(b->used);
+  free(b->costs);
+  free(b->penalties);
+  free(b->nodes);
+  free(b->parents);
+  free(b->degrees);
+  free(b->distances);
+  free(b);
+}
+
+/**
+ * Descarta as designações resolvidas de uma busca anterior, antes de reusar
+ * os limitantes em outra busca
+ *
+ * @param b os limitantes
+ *
+ * @returns void
+ */
+void reset_lower_bound(lower_bound *b) {
+  for (int size = 0; size <= b->n; size++) {
+    b->assignments[size].solved = 0;
+  }
+}
+
+/**
+ * Designa um sucessor a row pelo caminho aumentante mais barato, como no
+ * algoritmo húngaro. Os custos reduzidos das arestas (custo menos as
+ * variáveis duais das suas pontas) são mantidos não negativos, e os das
+ * arestas designadas, nulos, o que garante que a designação continue ótima.
+ *
+ * @param s o estado da busca
+ * @param a a designação, com row sem sucessor
+ * @param row a linha a designar
+ * @param m o número de colunas em s->bound->columns
+ *
+ * @returns 1 se row foi designada, 0 se não há caminho aumentante
+ */
+int augment_assignment(search *s, assignment *a, int row, int m) {
+  lower_bound *b = s->bound;
+  int n = b->n;
+  int last = s->current->nodes[s->current->size - 1];
+
+  for (int j = 0; j < m; j++) {
+    b->slacks[b->columns[j]] = COST_INFINITE;
+    b->used[b->columns[j]] = 0;
+  }
+
+  // O caminho começa pela coluna virtual n, designada a row
+  int column = n;
+  a->predecessors[n] = row;
+  do {
+    b->used[column] = 1;
+    int from = a->predecessors[column];
+    weight *w = MATRIX_ROW(s->adj, from);
+    int delta = COST_INFINITE, next = -1;
+
+    for (int j = 0; j < m; j++) {
+      int c = b->columns[j];
+      if (b->used[c]) {
+        continue;
+      }
+      /* O último nó não pode voltar direto a STARTING_NODE, já que ainda
+      há nós não visitados */
+      if (c != from && w[c] != MAX_COST &&
+          !(from == last && c == STARTING_NODE)) {
+        int reduced = w[c] - a->row_potentials[from] - a->column_potentials[c];
+        if (reduced < b->slacks[c]) {
+          b->slacks[c] = reduced;
+          b->ways[c] = column;
+        }
+      }
+      if (b->slacks[c] < delta) {
+        delta = b->slacks[c];
+        next = c;
+      }
+    }
+
+    if (next == -1) {
+      return 0;
+    }
+
+    a->row_potentials[row] += delta;
+    for (int j = 0; j < m; j++) {
+      int c = b->columns[j];
+      if (b->used[c]) {
+        a->row_potentials[a->predecessors[c]] += delta;
+        a->column_potentials[c] -= delta;
+      } else if (b->slacks[c] != COST_INFINITE) {
+        b->slacks[c] -= delta;
+      }
+    }
+    column = next;
+  } while (a->predecessors[column] != -1);
+
+  // Inverte as designações ao longo do caminho
+  do {
+    int previous = b->ways[column];
+    a->predecessors[column] = a->predecessors[previous];
+    a->successors[a->predecessors[column]] = column;
+    column = previous;
+  } while (column != n);
+
+  return 1;
+}
+
+/**
+ * Calcula o limitante do problema de designação para o restante dos ciclos
+ * que completam s->current. Cada nó não visitado e o último nó do caminho
+ * precisam de um sucessor distinto entre os nós não visitados e
+ * STARTING_NODE, e a designação de menor custo limita o restante do ciclo.
+ * Ao contrário da 1-tree, esse limitante respeita o sentido das arestas.
+ *
+ * A designação é mantida para cada tamanho do caminho. Se a do caminho sem o
+ * último nó está resolvida, ela é reaproveitada: a linha do penúltimo nó e a
+ * coluna do último deixam o problema, e só os nós que perderam o sucessor
+ * são designados de novo, em O(n²) cada, ao invés de resolver tudo em O(n³).
+ *
+ * @param s o estado da busca
+ *
+ * @returns o custo da designação, ou COST_INFINITE se não há nenhuma
+ */
+int get_assignment_bound(search *s) {
+  lower_bound *b = s->bound;
+  int n = b->n;
+  path *p = s->current;
+  int last = p->nodes[p->size - 1];
+  assignment *a = &b->assignments[p->size];
+
+  if (p->size >= 2 && b->assignments[p->size - 1].solved) {
+    memcpy(a->successors, b->assignments[p->size - 1].successors,
+           (4 * n + 2) * sizeof(int));
+    int previous = p->nodes[p->size - 2];
+    if (a->successors[previous] != -1) {
+      a->predecessors[a->successors[previous]] = -1;
+    }
+    if (a->predecessors[last] != -1) {
+      a->successors[a->predecessors[last]] = -1;
+    }
+    a->predecessors[last] = -1;
+
+    // A aresta de volta a STARTING_NODE deixa de ser permitida
+    if (a->successors[last] == STARTING_NODE) {
+      a->successors[last] = -1;
+      a->predecessors[STARTING_NODE] = -1;
+    }
+  } else {
+    memset(a->successors, -1, (2 * n + 1) * sizeof(int));
+    memset(a->row_potentials, 0, (2 * n + 1) * sizeof(int));
+  }
+
+  int m = 0;
+  b->columns[m++] = STARTING_NODE;
+  for (int w = 0; w < SET_WORDS(n); w++) {
+    for (unsigned long long set = s->unvisited[w]; set != 0; set &= set - 1) {
+      b->columns[m++] = (w * SET_WORD_BITS) + __builtin_ctzll(set);
+    }
+  }
+
+  // As linhas são o último nó e os não visitados, nas colunas 1 a m - 1
+  a->solved = 0;
+  int total = 0;
+  for (int j = 0; j < m; j++) {
+    int row = (j == 0) ? last : b->columns[j];
+    if (a->successors[row] == -1 && !augment_assignment(s, a, row, m)) {
+      return COST_INFINITE;
+    }
+  }
+  for (int j = 0; j < m; j++) {
+    int row = (j == 0) ? last : b->columns[j];
+    total += EDGE_COST(s->adj, row, a->successors[row]);
+  }
+  a->solved = 1;
+
+  return total;
+}
+
+/**
+ * Calcula um limitante inferior para o custo dos ciclos que completam
+ * s->current. O restante de um ciclo é um caminho que sai do último nó de
+ * s->current, passa por todos os nós não visitados e volta a STARTING_NODE.
+ * Esse caminho contém uma árvore geradora dos nós não visitados, mais uma
+ * aresta que sai do último nó e uma que chega em STARTING_NODE, então o custo
+ * dessa 1-tree mínima o limita.
+ *
+ * A 1-tree é calculada com o custo de cada aresta somado às penalidades dos
+ * seus nós, que são ajustadas por subgradiente para que os nós tenham grau 2,
+ * como em um caminho. Qualquer penalidade resulta em um limitante válido, então
+ * elas são mantidas de um cálculo para o outro.
+ *
+ * @param s o estado da busca
+ * @param cost o custo de s->current
+ * @param best_cost o melhor custo conhecido. O cálculo para assim que o
+ * limitante o ultrapassa.
+ *
+ * @returns o limitante, ou INFINITY se nenhum ciclo completa s->current
+ */
+double get_one_tree_bound(search *s, int cost, int best_cost) {
+  lower_bound *b = s->bound;
+  int n = b->n;
+  int last = s->current->nodes[s->current->size - 1];
+  double bound = 0;
+
+  int k = 0;
+  for (int w = 0; w < SET_WORDS(n); w++) {
+    for (unsigned long long set = s->unvisited[w]; set != 0; set &= set - 1) {
+      b->nodes[k++] = (w * SET_WORD_BITS) + __builtin_ctzll(set);
+    }
+  }
+
+  for (int iteration = 0; iteration < BOUND_ITERATIONS; iteration++) {
+    double value = cost;
+    for (int j = 0; j < k; j++) {
+      value -= 2 * b->penalties[b->nodes[j]];
+      b->degrees[j] = 0;
+      b->parents[j] = 0;
+      b->distances[j] = INFINITY;
+    }
+
+    // Árvore geradora mínima dos nós não visitados, pelo algoritmo de Prim
+    for (int added = 0, next = 0; added < k; added++) {
+      int u = b->nodes[next];
+      if (added > 0) {
+        value += b->distances[next];
+        b->degrees[next]++;
+        b->degrees[b->parents[next]]++;
+      }
+      b->parents[next] = -1; // Marca o nó como parte da árvore
+
+      int closest = -1;
+      for (int j = 0; j < k; j++) {
+        if (b->parents[j] == -1) {
+          continue;
+        }
+        int edge = b->costs[u * n + b->nodes[j]];
+        double distance = edge + b->penalties[u] + b->penalties[b->nodes[j]];
+        if (edge != COST_INFINITE && distance < b->distances[j]) {
+          b->distances[j] = distance;
+          b->parents[j] = next;
+        }
+        if (closest == -1 || b->distances[j] < b->distances[closest]) {
+          closest = j;
+        }
+      }
+
+      if (added < k - 1 && b->distances[closest] == INFINITY) {
+        return INFINITY; // Os nós não visitados não são conexos
+      }
+      next = closest;
+    }
+
+    // As arestas que ligam a árvore ao último nó e a STARTING_NODE
+    int out = -1, in = -1;
+    weight *row = MATRIX_ROW(s->adj, last);
+    for (int j = 0; j < k; j++) {
+      int u = b->nodes[j];
+      int edge = EDGE_COST(s->adj, u, STARTING_NODE);
+      if (row[u] != MAX_COST &&
+          (out == -1 || row[u] + b->penalties[u] <
+                            row[b->nodes[out]] + b->penalties[b->nodes[out]])) {
+        out = j;
+      }
+      if (edge != MAX_COST &&
+          (in == -1 || edge + b->penalties[u] <
+                           EDGE_COST(s->adj, b->nodes[in], STARTING_NODE) +
+                               b->penalties[b->nodes[in]])) {
+        in = j;
+      }
+    }
+
+    if (out == -1 || in == -1) {
+      return INFINITY;
+    }
+    value += row[b->nodes[out]] + b->penalties[b->nodes[out]];
+    value += EDGE_COST(s->adj, b->nodes[in], STARTING_NODE) +
+             b->penalties[b->nodes[in]];
+    b->degrees[out]++;
+    b->degrees[in]++;
+
+    if (value > bound) {
+      bound = value;
+    }
+    if (bound > best_cost + BOUND_EPSILON) {
+      break;
+    }
+
+    // Passo do subgradiente, proporcional à distância até o melhor custo
+    int norm = 0;
+    for (int j = 0; j < k; j++) {
+      norm += (b->degrees[j] - 2) * (b->degrees[j] - 2);
+    }
+    if (norm == 0) {
+      break; // A 1-tree já é um caminho, e o limitante não melhora
+    }
+    double step = BOUND_STEP * (best_cost - value) / norm;
+    for (int j = 0; j < k; j++) {
+      b->penalties[b->nodes[j]] += step * (b->degrees[j] - 2);
+    }
+  }
+
+  return bound;
+}
+
+/**
+ * Verifica se os ciclos que completam s->current podem ser podados, ou seja,
+ * se um limitante inferior do seu custo é maior que o melhor custo conhecido.
+ * A comparação é estrita para manter todos os empates. O limitante da
+ * designação, mais barato, é calculado primeiro, e o 1-tree só se ele não
+ * bastar para a poda. Os limitantes só são calculados se restarem ao menos
+ * BOUND_MIN_REMAINING nós, já que abaixo disso a busca é mais barata que eles.
+ *
+ * @param s o estado da busca, com s->bound não nulo
+ * @param cost o custo de s->current
+ *
+ * @returns 1 se os ciclos podem ser podados, 0 caso contrário
+ */
+int exceeds_lower_bound(search *s, int cost) {
+  int best_cost = get_best_cost(s->best_cost);
+  if (best_cost == COST_INFINITE ||
+      s->n - s->current->size < BOUND_MIN_REMAINING) {
+    // Os filhos não podem reaproveitar essa designação
+    s->bound->assignments[s->current->size].solved = 0;
+    return 0;
+  }
+
+  int assignment_cost = get_assignment_bound(s);
+  if (assignment_cost == COST_INFINITE ||
+      cost + assignment_cost > best_cost) {
+    return 1;
+  }
+
+  return get_one_tree_bound(s, cost, best_cost) > best_cost + BOUND_EPSILON;
+}
+
+/*
+****** Utilidades para a solução inicial ******
+*/
+
+/**
+ * Constrói um ciclo pelo vizinho mais próximo: a partir de first, o ciclo
+ * segue sempre para o nó não visitado mais barato e, no fim, volta a first
+ *
+ * @param adj a matriz de adjacências do grafo
+ * @param first o nó inicial
+ * @param tour onde o ciclo é escrito, com n + 1 nós, começando e terminando
+ * em first
+ *
+ * @returns o custo do ciclo, ou COST_INFINITE se a construção chegou a um nó
+ * sem arestas para os nós restantes
+ */
+int build_nearest_neighbor_tour(cost_matrix *adj, int first, int *tour) {
+  int n = adj->n;
+  int cost = 0;
+  char *visited = (char *)calloc(n, sizeof(char));
+
+  tour[0] = first;
+  visited[first] = 1;
+  for (int size = 1; size < n; size++) {
+    weight *row = MATRIX_ROW(adj, tour[size - 1]);
+    int next = -1;
+    for (int i = 0; i < n; i++) {
+      if (!visited[i] && row[i] != MAX_COST &&
+          (next == -1 || row[i] < row[next])) {
+        next = i;
+      }
+    }
+
+    if (next == -1) {
+      free(visited);
+      return COST_INFINITE;
+    }
+    visited[next] = 1;
+    tour[size] = next;
+    cost += row[next];
+  }
+  free(visited);
+
+  tour[n] = first;
+  int edge = EDGE_COST(adj, tour[n - 1], first);
+  return (edge == MAX_COST) ? COST_INFINITE : cost + edge;
+}
+
+/**
+ * Melhora um ciclo com 2-opt: o trecho tour[i..j] é invertido sempre que isso
+ * reduz o custo do ciclo, até que nenhuma inversão o reduza. Como o grafo é
+ * direcionado, as arestas do trecho invertido são somadas no sentido
+ * contrário. O primeiro e o último nó do ciclo não saem do lugar.
+ *
+ * @param adj a matriz de adjacências do grafo
+ * @param tour o ciclo, com n + 1 nós, modificado no lugar
+ * @param cost o custo do ciclo
+ *
+ * @returns o custo do ciclo melhorado
+ */
+int improve_tour(cost_matrix *adj, int *tour, int cost) {
+  int n = adj->n;
+
+  for (int improved = 1; improved;) {
+    improved = 0;
+    for (int i = 1; i < n - 1; i++) {
+      int forward = 0, backward = 0; // O custo de tour[i..j] nos dois sentidos
+      for (int j = i + 1; j < n; j++) {
+        int reverse = EDGE_COST(adj, tour[j], tour[j - 1]);
+        if (reverse == MAX_COST) {
+          break; // Nenhum trecho que contenha essa aresta pode ser invertido
+        }
+        forward += EDGE_COST(adj, tour[j - 1], tour[j]);
+        backward += reverse;
+
+        int in = EDGE_COST(adj, tour[i - 1], tour[j]);
+        int out = EDGE_COST(adj, tour[i], tour[j + 1]);
+        if (in == MAX_COST || out == MAX_COST) {
+          continue;
+        }
+
+        int delta = (in + backward + out) -
+                    (EDGE_COST(adj, tour[i - 1], tour[i]) + forward +
+                     EDGE_COST(adj, tour[j], tour[j + 1]));
+        if (delta < 0) {
+          for (int a = i, b = j; a < b; a++, b--) {
+            int node = tour[a];
+            tour[a] = tour[b];
+            tour[b] = node;
+          }
+          cost += delta;
+          improved = 1;
+          break; // Os custos dos trechos a partir de i mudaram
+        }
+      }
+    }
+  }
+
+  return cost;
+}
+
+/**
+ * Calcula o custo de uma solução inicial para o branch and bound: o menor
+ * entre os ciclos construídos pelo vizinho mais próximo a partir dos nós
+ * first, first + step, first + 2 * step, ..., melhorados com 2-opt. A busca
+ * começa a podar com esse custo, ao invés de esperar pelo primeiro caminho
+ * completo. O ciclo em si não é guardado, já que a busca o encontra de novo
+ * se ele for ótimo.
+ *
+ * @param adj a matriz de adjacências do grafo
+ * @param first o primeiro nó inicial
+ * @param step a distância entre dois nós iniciais
+ *
+ * @returns o custo, ou COST_INFINITE se nenhum ciclo foi encontrado
+ */
+int get_warm_start_cost(cost_matrix *adj, int first, int step) {
+  int n = adj->n;
+  int best_cost = COST_INFINITE;
+  int *tour = (int *)malloc((n + 1) * sizeof(int));
+
+  for (int start = first; start < n; start += step) {
+    int cost = build_nearest_neighbor_tour(adj, start, tour);
+    if (cost != COST_INFINITE) {
+      cost = improve_tour(adj, tour, cost);
+      if (cost < best_cost) {
+        best_cost = cost;
+      }
+    }
+  }
+
+  free(tour);
+  return best_cost;
+}
+
+/**
+ * Calcula o custo de uma solução inicial com todas as threads de todos os
+ * processos, cada uma a partir de nós iniciais diferentes (veja
+ * get_warm_start_cost), e o distribui a todos os processos. Todos os
+ * processos devem chamar essa função.
+ *
+ * @param adj a matriz de adjacências do grafo
+ * @param known_cost o custo de um ciclo já conhecido pelo processo, ou
+ * COST_INFINITE
+ * @param world_size o número de processos
+ * @param rank o rank do processo
+ *
+ * @returns o menor custo encontrado, ou COST_INFINITE
+ */
+int get_shared_warm_start_cost(cost_matrix *adj, int known_cost,
+                               int world_size, int rank) {
+  int cost = known_cost;
+
+#pragma omp parallel num_threads(THREADS) reduction(min : cost)
+  cost = get_warm_start_cost(adj, (rank * THREADS) + omp_get_thread_num(),
+                             world_size * THREADS);
+
+  int best_cost;
+  MPI_Allreduce(&cost, &best_cost, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+  return best_cost;
+}
+
+/*
+****** Utilidades para as folhas da busca ******
+*/
+
+/**
+ * Preenche as tabelas leaf_permutations e leaf_edges. Na matriz edges de
+ * search_leaves, os índices 0 a LEAF_LEVELS - 1 são os nós restantes, e o
+ * índice LEAF_LEVELS é o último nó do caminho, nas linhas, e STARTING_NODE,
+ * nas colunas.
+ *
+ * @returns void
+ */
+void fill_leaf_tables() {
+  int order[LEAF_LEVELS];
+  for (int k = 0; k < LEAF_LEVELS; k++) {
+    order[k] = k;
+  }
+
+  for (int p = 0; p < LEAF_PERMUTATIONS; p++) {
+    memcpy(leaf_permutations[p], order, sizeof(order));
+    int from = LEAF_LEVELS;
+    for (int k = 0; k <= LEAF_LEVELS; k++) {
+      int to = (k < LEAF_LEVELS) ? order[k] : LEAF_LEVELS;
+      leaf_edges[k][p] = (from * (LEAF_LEVELS + 1)) + to;
+      from = to;
+    }
+
+    // Próxima permutação em ordem lexicográfica
+    int i = LEAF_LEVELS - 2;
+    while (i >= 0 && order[i] > order[i + 1]) {
+      i--;
+    }
+    if (i < 0) {
+      break;
+    }
+    int j = LEAF_LEVELS - 1;
+    while (order[j] < order[i]) {
+      j--;
+    }
+    int node = order[i];
+    order[i] = order[j];
+    order[j] = node;
+    for (int a = i + 1, b = LEAF_LEVELS - 1; a < b; a++, b--) {
+      node = order[a];
+      order[a] = order[b];
+      order[b] = node;
+    }
+  }
+}
+
+/**
+ * Calcula o custo de cada ordem dos nós dos níveis finais, sem instruções
+ * vetoriais
+ *
+ * @param edges a matriz de custos dos níveis finais (veja search_leaves)
+ * @param minimum onde é escrito o menor custo
+ *
+ * @returns a máscara das ordens com o menor custo
+ */
+unsigned int evaluate_leaves_scalar(const int *edges, int *minimum) {
+  int costs[LEAF_PERMUTATIONS];
+  *minimum = INT_MAX;
+  for (int p = 0; p < LEAF_PERMUTATIONS; p++) {
+    costs[p] = 0;
+    for (int k = 0; k <= LEAF_LEVELS; k++) {
+      costs[p] += edges[leaf_edges[k][p]];
+    }
+    if (costs[p] < *minimum) {
+      *minimum = costs[p];
+    }
+  }
+
+  unsigned int ties = 0;
+  for (int p = 0; p < LEAF_PERMUTATIONS; p++) {
+    ties |= (unsigned int)(costs[p] == *minimum) << p;
+  }
+  return ties;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/**
+ * Calcula o custo de cada ordem dos nós dos níveis finais com SSE4.1, quatro
+ * ordens por vez
+ *
+ * @param edges a matriz de custos dos níveis finais (veja search_leaves)
+ * @param minimum onde é escrito o menor custo
+ *
+ * @returns a máscara das ordens com o menor custo
+ */
+__attribute__((target("sse4.1"))) unsigned int
+evaluate_leaves_sse(const int *edges, int *minimum) {
+  __m128i costs[LEAF_PERMUTATIONS / 4];
+  __m128i best = _mm_set1_epi32(INT_MAX);
+  for (int v = 0; v < LEAF_PERMUTATIONS / 4; v++) {
+    costs[v] = _mm_setzero_si128();
+    for (int k = 0; k <= LEAF_LEVELS; k++) {
+      const int *index = &leaf_edges[k][v * 4];
+      costs[v] = _mm_add_epi32(
+          costs[v], _mm_setr_epi32(edges[index[0]], edges[index[1]],
+                                   edges[index[2]], edges[index[3]]));
+    }
+    best = _mm_min_epi32(best, costs[v]);
+  }
+
+  // O mínimo entre as quatro posições, repetido em todas elas
+  best = _mm_min_epi32(best, _mm_shuffle_epi32(best, _MM_SHUFFLE(1, 0, 3, 2)));
+  best = _mm_min_epi32(best, _mm_shuffle_epi32(best, _MM_SHUFFLE(2, 3, 0, 1)));
+  *minimum = _mm_cvtsi128_si32(best);
+
+  unsigned int ties = 0;
+  for (int v = 0; v < LEAF_PERMUTATIONS / 4; v++) {
+    __m128i equal = _mm_cmpeq_epi32(costs[v], best);
+    ties |= (unsigned int)_mm_movemask_ps(_mm_castsi128_ps(equal)) << (v * 4);
+  }
+  return ties;
+}
+
+/**
+ * Calcula o custo de cada ordem dos nós dos níveis finais com AVX2, oito
+ * ordens por vez, lendo as arestas de edges com gather
+ *
+ * @param edges a matriz de custos dos níveis finais (veja search_leaves)
+ * @param minimum onde é escrito o menor custo
+ *
+ * @returns a máscara das ordens com o menor custo
+ */
+__attribute__((target("avx2"))) unsigned int
+evaluate_leaves_avx2(const int *edges, int *minimum) {
+  __m256i costs[LEAF_PERMUTATIONS / 8];
+  __m256i best = _mm256_set1_epi32(INT_MAX);
+  for (int v = 0; v < LEAF_PERMUTATIONS / 8; v++) {
+    costs[v] = _mm256_setzero_si256();
+    for (int k = 0; k <= LEAF_LEVELS; k++) {
+      __m256i index = _mm256_load_si256((const __m256i *)&leaf_edges[k][v * 8]);
+      costs[v] =
+          _mm256_add_epi32(costs[v], _mm256_i32gather_epi32(edges, index, 4));
+    }
+    best = _mm256_min_epi32(best, costs[v]);
+  }
+
+  // O mínimo entre as oito posições, repetido em todas elas
+  best = _mm256_min_epi32(best, _mm256_permute2x128_si256(best, best, 1));
+  best = _mm256_min_epi32(best,
+                          _mm256_shuffle_epi32(best, _MM_SHUFFLE(1, 0, 3, 2)));
+  best = _mm256_min_epi32(best,
+                          _mm256_shuffle_epi32(best, _MM_SHUFFLE(2, 3, 0, 1)));
+  *minimum = _mm256_cvtsi256_si32(best);
+
+  unsigned int ties = 0;
+  for (int v = 0; v < LEAF_PERMUTATIONS / 8; v++) {
+    __m256i equal = _mm256_cmpeq_epi32(costs[v], best);
+    ties |= (unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(equal))
+            << (v * 8);
+  }
+  return ties;
+}
+#endif
+
+// A implementação de evaluate_leaves escolhida por select_leaf_kernel
+leaf_kernel evaluate_leaves = evaluate_leaves_scalar;
+
+/**
+ * Preenche as tabelas das folhas e escolhe a implementação de
+ * evaluate_leaves com as instruções vetoriais suportadas pelo processador,
+ * consultadas com CPUID
+ *
+ * @returns void
+ */
+void select_leaf_kernel() {
+  fill_leaf_tables();
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    evaluate_leaves = evaluate_leaves_avx2;
+  } else if (__builtin_cpu_supports("sse4.1")) {
+    evaluate_leaves = evaluate_leaves_sse;
+  }
+#endif
+}
+
+/*
+********** Utilidades para checkpoints **********
+*/
+
+/* Cada processo grava em ARQUIVO.<rank> as tarefas da fila que resolveu.
+Depois do cabeçalho, cada tarefa é um registro com CHECKPOINT_RECORD_FIELDS
+inteiros (o índice da tarefa, o número de caminhos guardados, o custo e o
+número de caminhos com esse custo), seguidos dos caminhos empacotados por
+serialize_path_list. O melhor custo conhecido é o menor custo entre os
+registros. Como o índice de uma tarefa depende apenas de n e da profundidade
+dos prefixos, os arquivos podem ser retomados com outro número de
+processos. */
+
+/**
+ * Calcula o hash FNV-1a dos pesos de uma matriz, que identifica a instância
+ * de um checkpoint
+ *
+ * @param adj a matriz de adjacências do grafo
+ *
+ * @returns o hash dos pesos, linha a linha
+ */
+unsigned long long get_matrix_hash(cost_matrix *adj) {
+  unsigned long long hash = FNV_OFFSET_BASIS;
+
+  for (int i = 0; i < adj->n; i++) {
+    unsigned char *row = (unsigned char *)MATRIX_ROW(adj, i);
+    for (size_t j = 0; j < adj->n * sizeof(weight); j++) {
+      hash = (hash ^ row[j]) * FNV_PRIME;
+    }
+  }
+
+  return hash;
+}
+
+/**
+ * Preenche o cabeçalho dos checkpoints de uma instância
+ *
+ * @param header o cabeçalho a ser preenchido
+ * @param adj a matriz de adjacências do grafo
+ * @param q a fila de tarefas
+ * @param output o modo de saída (OUTPUT_*)
+ *
+ * @returns void
+ */
+void fill_checkpoint_header(checkpoint_header *header, cost_matrix *adj,
+                            task_queue *q, int output) {
+  memset(header, 0, sizeof(checkpoint_header)); // Zera os bytes de alinhamento
+  memcpy(header->magic, CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_SIZE);
+  header->n = adj->n;
+  header->depth = q->depth;
+  header->output = output;
+  header->hash = get_matrix_hash(adj);
+}
+
+/**
+ * Monta o nome do checkpoint de um processo
+ *
+ * @param prefix o prefixo dos arquivos de checkpoint
+ * @param rank o rank do processo
+ *
+ * @returns o nome "<prefix>.<rank>", alocado dinamicamente
+ */
+char *get_checkpoint_name(char *prefix, int rank) {
+  size_t size = strlen(prefix) + 16;
+  char *name = (char *)malloc(size * sizeof(char));
+  snprintf(name, size, "%s.%d", prefix, rank);
+  return name;
+}
+
+/**
+ * Lê os registros de um checkpoint, marca as tarefas como resolvidas e junta
+ * os seus caminhos a res. Um registro incompleto no fim do arquivo, de uma
+ * execução interrompida durante a escrita, é ignorado, assim como os
+ * registros de tarefas já lidas.
+ *
+ * @param file o checkpoint, já depois do cabeçalho
+ * @param q a fila de tarefas da manager
+ * @param n o número de nós no grafo
+ * @param res a path list da manager
+ *
+ * @returns a posição do fim do último registro completo
+ */
+long read_checkpoint_records(FILE *file, task_queue *q, int n,
+                             path_list *res) {
+  size_t packed_size = get_packed_path_size(n);
+  long long record[CHECKPOINT_RECORD_FIELDS];
+  long end = ftell(file);
+
+  while (fread(record, sizeof(long long), CHECKPOINT_RECORD_FIELDS, file) ==
+         CHECKPOINT_RECORD_FIELDS) {
+    int task = (int)record[0];
+    int num_paths = (int)record[1];
+    if (task < 0 || task >= q->count || num_paths < 0 ||
+        num_paths > record[3]) {
+      return end;
+    }
+
+    unsigned char *spl = (unsigned char *)malloc(packed_size * num_paths + 1);
+    if (fread(spl, packed_size, num_paths, file) != (size_t)num_paths) {
+      free(spl);
+      return end;
+    }
+
+    if (!q->finished[task]) {
+      q->finished[task] = 1;
+      path_list *other = deserialize_path_list(spl, num_paths, n);
+      other->cost = (int)record[2];
+      other->count = record[3];
+      merge_path_lists(res, other);
+      delete_path_list_paths(other);
+      delete_path_list(other);
+    }
+    free(spl);
+    end = ftell(file);
+  }
+
+  return end;
+}
+
+/**
+ * Retoma os checkpoints de uma execução anterior, que podem ter sido
+ * gravados por qualquer número de processos: são lidos os arquivos
+ * <prefix>.0, <prefix>.1, ... até o primeiro que não existe. Cada arquivo é
+ * cortado no fim do seu último registro completo, para que os próximos
+ * registros sejam acrescentados depois dele. Executada só pela manager,
+ * antes da busca.
+ *
+ * @param q a fila de tarefas da manager
+ * @param prefix o prefixo dos arquivos de checkpoint
+ * @param adj a matriz de adjacências do grafo
+ * @param output o modo de saída (OUTPUT_*)
+ * @param res a path list da manager, que recebe os caminhos das tarefas
+ * já resolvidas
+ *
+ * @returns 0 se os checkpoints são dessa instância, ou 1 caso contrário
+ */
+int restore_checkpoints(task_queue *q, char *prefix, cost_matrix *adj,
+                        int output, path_list *res) {
+  checkpoint_header expected;
+  fill_checkpoint_header(&expected, adj, q, output);
+  q->finished = (char *)calloc(q->count + 1, sizeof(char));
+
+  for (int rank = 0;; rank++) {
+    char *name = get_checkpoint_name(prefix, rank);
+    FILE *file = fopen(name, "rb");
+    if (file == NULL) {
+      free(name);
+      return 0;
+    }
+
+    // Um arquivo sem o cabeçalho completo é descartado
+    checkpoint_header header;
+    long end = 0;
+    if (fread(&header, sizeof(checkpoint_header), 1, file) == 1) {
+      if (memcmp(&header, &expected, sizeof(checkpoint_header)) != 0) {
+        printf("O checkpoint %s não é dessa instância, com essas opções.\n",
+               name);
+        fclose(file);
+        free(name);
+        return 1;
+      }
+      end = read_checkpoint_records(file, q, adj->n, res);
+    }
+    fclose(file);
+
+    if (truncate(name, end) != 0) {
+      printf("Não foi possível sobrescrever o checkpoint %s.\n", name);
+      free(name);
+      return 1;
+    }
+    free(name);
+  }
+}
+
+/**
+ * Abre o checkpoint do processo para acrescentar os registros das próximas
+ * tarefas, e escreve o cabeçalho se o arquivo é novo. Os workers não sabem
+ * se o arquivo da manager pôde ser aberto, então a execução é abortada.
+ *
+ * @param q a fila de tarefas
+ * @param prefix o prefixo dos arquivos de checkpoint
+ * @param adj a matriz de adjacências do grafo
+ * @param output o modo de saída (OUTPUT_*)
+ *
+ * @returns void
+ */
+void open_checkpoint(task_queue *q, char *prefix, cost_matrix *adj,
+                     int output) {
+  char *name = get_checkpoint_name(prefix, q->rank);
+  q->checkpoint = fopen(name, "ab");
+  if (q->checkpoint == NULL) {
+    printf("Não foi possível abrir o checkpoint %s.\n", name);
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+
+  fseek(q->checkpoint, 0, SEEK_END);
+  if (ftell(q->checkpoint) == 0) {
+    checkpoint_header header;
+    fill_checkpoint_header(&header, adj, q, output);
+    fwrite(&header, sizeof(checkpoint_header), 1, q->checkpoint);
+  }
+
+  q->synced_at = get_time();
+  free(name);
+}
+
+/**
+ * Acrescenta ao checkpoint do processo o registro de uma tarefa resolvida.
+ * A escrita fica no buffer do arquivo, que só é gravado em disco a cada
+ * CHECKPOINT_SYNC_INTERVAL segundos, para que o checkpoint não atrase a
+ * busca.
+ *
+ * @param q a fila de tarefas
+ * @param task o índice da tarefa
+ * @param pl os caminhos de menor custo da tarefa
+ * @param n o número de nós no grafo
+ *
+ * @returns void
+ */
+void write_checkpoint(task_queue *q, int task, path_list *pl, int n) {
+  long long record[CHECKPOINT_RECORD_FIELDS] = {
+      task, pl->size, get_path_list_paths_cost(pl), pl->count};
+  unsigned char *spl = serialize_path_list(pl, n);
+
+#pragma omp critical(checkpoint)
+  {
+    size_t written =
+        fwrite(record, sizeof(long long), CHECKPOINT_RECORD_FIELDS,
+               q->checkpoint) +
+        fwrite(spl, get_packed_path_size(n), pl->size, q->checkpoint);
+    if (written != (size_t)(CHECKPOINT_RECORD_FIELDS + pl->size)) {
+      printf("Não foi possível escrever no checkpoint.\n");
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    double now = get_time();
+    if (now - q->synced_at >= CHECKPOINT_SYNC_INTERVAL) {
+      fflush(q->checkpoint);
+      fsync(fileno(q->checkpoint));
+      q->synced_at = now;
+    }
+  }
+
+  free(spl);
+}
+
+/**
+ * Grava em disco e fecha o checkpoint do processo
+ *
+ * @param q a fila de tarefas
+ *
+ * @returns void
+ */
+void close_checkpoint(task_queue *q) {
+  fflush(q->checkpoint);
+  fsync(fileno(q->checkpoint));
+  fclose(q->checkpoint);
+  q->checkpoint = NULL;
+}
+
+/*
+********* Funções do problema principal *********
+*/
+
+/**
+ * Gera uma matriz de custos para o grafo
+ *
+ * @param n o número de vértices do grafo
+ *
+ * @returns a matriz de custos das arestas
+ */
+cost_matrix *get_cost_matrix(int n) {
+  cost_matrix *matrix = new_matrix(n);
+  for (int i = 0; i < n; i++) {
+    weight *row = MATRIX_ROW(matrix, i);
+    for (int j = 0; j < n; j++) {
+      row[j] = rand() % (MAX_COST + 1);
+    }
+    row[i] = 0;
+  }
+
+  return matrix;
+}
+
+/**
+ * Cria a máscara dos nós ainda não visitados de uma busca, com todos os nós
+ * do grafo exceto os de initial, alocada na arena da thread
+ *
+ * @param n o número de nós no grafo
+ * @param initial os nós já visitados
+ * @param size o número de nós em initial
+ *
+ * @returns a máscara, com SET_WORDS(n) palavras
+ */
+unsigned long long *new_unvisited_set(int n, int *initial, int size) {
+  unsigned long long *set = (unsigned long long *)arena_alloc(
+      path_arena, SET_WORDS(n) * sizeof(unsigned long long));
+  for (int w = 0; w < SET_WORDS(n); w++) {
+    int bits = n - (w * SET_WORD_BITS);
+    set[w] = (bits >= SET_WORD_BITS) ? ~0ull : (1ull << bits) - 1;
+  }
+
+  for (int i = 0; i < size; i++) {
+    set[initial[i] / SET_WORD_BITS] &= ~(1ull << (initial[i] % SET_WORD_BITS));
+  }
+
+  return set;
+}
+
+/**
+ * Libera a máscara criada por new_unvisited_set
+ *
+ * @param set a máscara
+ * @param n o número de nós no grafo
+ *
+ * @returns void
+ */
+void delete_unvisited_set(unsigned long long *set, int n) {
+  arena_free(path_arena, set, SET_WORDS(n) * sizeof(unsigned long long));
+}
+
+/**
+ * Registra um caminho completo encontrado pela busca. Se ele for mais barato
+ * que os caminhos encontrados até então, eles são descartados. Cada thread
+ * registra os caminhos na sua própria lista, e caminhos mais caros que o
+ * melhor custo conhecido por todas as threads nem chegam a ser guardados.
+ *
+ * @param s o estado da busca, com o caminho completo em s->current
+ * @param cost o custo do caminho completo
+ *
+ * @returns void
+ */
+void record_search_path(search *s, int cost) {
+  if (s->best_cost != NULL && cost > get_best_cost(s->best_cost)) {
+    COUNT_SEARCH(s, COUNTER_PRUNED);
+    return;
+  }
+
+  if (s->res->count > 0 && cost == s->res->cost) {
+    COUNT_SEARCH(s, COUNTER_TIES);
+  }
+  add_to_path_list(s->res, s->current, cost);
+
+  if (s->best_cost != NULL) {
+    update_best_cost(s->best_cost, cost);
+  }
+}
+
+#ifdef SEARCH_STATS
+/**
+ * Conta os ramos dos níveis finais avaliados por search_leaves como a busca
+ * em profundidade os contaria, com a poda pelo melhor custo conhecido no
+ * início da avaliação. Só é compilada com os contadores da busca.
+ *
+ * @param s o estado da busca
+ * @param edges a matriz de custos dos níveis finais (veja search_leaves)
+ * @param from a linha de edges do último nó do caminho
+ * @param visited a máscara dos nós restantes já visitados
+ * @param cost o custo do caminho até from
+ *
+ * @returns void
+ */
+void count_leaf_search(search *s, const int *edges, int from,
+                       unsigned int visited, int cost) {
+  const int *row = edges + (from * (LEAF_LEVELS + 1));
+  if (visited == (1u << LEAF_LEVELS) - 1) {
+    COUNT_SEARCH(s, COUNTER_LEAVES);
+    if (row[LEAF_LEVELS] == LEAF_MISSING) {
+      COUNT_SEARCH(s, COUNTER_INFEASIBLE);
+    }
+    return;
+  }
+
+  for (int j = 0; j < LEAF_LEVELS; j++) {
+    if (visited & (1u << j)) {
+      continue;
+    } else if (row[j] == LEAF_MISSING) {
+      COUNT_SEARCH(s, COUNTER_INFEASIBLE);
+    } else if (s->best_cost != NULL &&
+               cost + row[j] > get_best_cost(s->best_cost)) {
+      COUNT_SEARCH(s, COUNTER_PRUNED);
+    } else {
+      COUNT_SEARCH(s, COUNTER_EXPANDED);
+      count_leaf_search(s, edges, j, visited | (1u << j), cost + row[j]);
+    }
+  }
+}
+#endif
+
+/**
+ * Avalia de uma só vez todos os ciclos que completam um caminho ao qual
+ * faltam exatamente LEAF_LEVELS nós. Os custos das arestas entre os nós
+ * restantes, o último nó e STARTING_NODE são copiados para uma pequena
+ * matriz, o custo de cada ordem dos nós restantes é somado com instruções
+ * vetoriais (veja select_leaf_kernel), e só as ordens de menor custo são
+ * registradas, na mesma ordem em que a busca em profundidade as encontraria.
+ * Como as demais seriam descartadas ao registrar as de menor custo, a
+ * resposta é a mesma.
+ *
+ * @param s o estado da busca
+ * @param size o número de nós no caminho
+ * @param nodes os LEAF_LEVELS nós restantes, em ordem crescente
+ * @param cost o custo do caminho
+ *
+ * @returns void
+ */
+void search_leaves(search *s, int size, int *nodes, int cost) {
+  path *p = s->current;
+  _Alignas(32) int edges[(LEAF_LEVELS + 1) * (LEAF_LEVELS + 1)];
+  for (int i = 0; i <= LEAF_LEVELS; i++) {
+    weight *row =
+        MATRIX_ROW(s->adj, (i < LEAF_LEVELS) ? nodes[i] : p->nodes[size - 1]);
+    for (int j = 0; j <= LEAF_LEVELS; j++) {
+      int edge = row[(j < LEAF_LEVELS) ? nodes[j] : STARTING_NODE];
+      edges[(i * (LEAF_LEVELS + 1)) + j] =
+          (edge == MAX_COST) ? LEAF_MISSING : edge;
+    }
+  }
+
+  int minimum;
+  unsigned int ties = evaluate_leaves(edges, &minimum);
+#ifdef SEARCH_STATS
+  count_leaf_search(s, edges, LEAF_LEVELS, 0, cost);
+#endif
+  if (minimum >= LEAF_MISSING ||
+      (s->best_cost != NULL && cost + minimum > get_best_cost(s->best_cost))) {
+    return;
+  }
+
+  int current_size = p->size;
+  for (; ties != 0; ties &= ties - 1) {
+    int *order = leaf_permutations[__builtin_ctz(ties)];
+    for (int k = 0; k < LEAF_LEVELS; k++) {
+      p->nodes[size + k] = nodes[order[k]];
+    }
+    p->nodes[size + LEAF_LEVELS] = STARTING_NODE;
+    p->size = size + LEAF_LEVELS + 1;
+    record_search_path(s, cost + minimum);
+  }
+  p->size = current_size;
+}
+
+// Os kernels especializados, definidos abaixo de search_path
+extern search_kernel search_kernels[SPECIALIZED_MAX_SIZE + 1];
+
+/**
+ * Busca em profundidade a partir de s->current. Os nós são empilhados e
+ * desempilhados no próprio caminho, e os nós visitados são mantidos em
+ * uma máscara de bits. O custo do caminho é atualizado a cada aresta
+ * adicionada, e arestas inexistentes são descartadas assim que encontradas.
+ *
+ * @param s o estado da busca
+ * @param cost o custo de s->current
+ *
+ * @returns void
+ */
+void search_path(search *s, int cost) {
+  path *p = s->current;
+  weight *row = MATRIX_ROW(s->adj, p->nodes[p->size - 1]);
+
+  /* Com o limitante inferior, os últimos níveis, onde ele não é calculado,
+  ficam com o kernel especializado */
+  if (s->bound != NULL && s->n >= 1 && s->n <= SPECIALIZED_MAX_SIZE &&
+      s->n - p->size < BOUND_MIN_REMAINING) {
+    int size = p->size;
+    search_kernels[s->n](s, size, (unsigned int)s->unvisited[0], cost);
+    p->size = size;
+    return;
+  }
+
+  if (LEAF_SEARCH && s->n - p->size == LEAF_LEVELS) {
+    int nodes[LEAF_LEVELS], k = 0;
+    for (int w = 0; w < SET_WORDS(s->n); w++) {
+      for (unsigned long long set = s->unvisited[w]; set != 0; set &= set - 1) {
+        nodes[k++] = (w * SET_WORD_BITS) + __builtin_ctzll(set);
+      }
+    }
+    search_leaves(s, p->size, nodes, cost);
+    return;
+  }
+
+  if (p->size == s->n) { // Caso base da recursão
+    int edge = row[STARTING_NODE];
+    COUNT_SEARCH(s, COUNTER_LEAVES);
+    if (edge != MAX_COST) {
+      p->nodes[p->size++] = STARTING_NODE;
+      record_search_path(s, cost + edge);
+      p->size--;
+    } else {
+      COUNT_SEARCH(s, COUNTER_INFEASIBLE);
+    }
+    return;
+  }
+
+  for (int w = 0; w < SET_WORDS(s->n); w++) {
+    unsigned long long candidates = s->unvisited[w];
+    while (candidates != 0) {
+      int i = (w * SET_WORD_BITS) + __builtin_ctzll(candidates);
+      candidates &= candidates - 1;
+
+      int edge = row[i];
+      if (edge == MAX_COST) {
+        COUNT_SEARCH(s, COUNTER_INFEASIBLE);
+        continue;
+      }
+
+      /* poda os ramos cujo custo parcial já é maior que o melhor custo
+      conhecido. A comparação é estrita para manter todos os empates */
+      if (s->best_cost != NULL && cost + edge > get_best_cost(s->best_cost)) {
+        COUNT_SEARCH(s, COUNTER_PRUNED);
+        continue;
+      }
+
+      p->nodes[p->size++] = i;
+      s->unvisited[w] &= ~(1ull << (i % SET_WORD_BITS));
+      if (s->bound != NULL && exceeds_lower_bound(s, cost + edge)) {
+        COUNT_SEARCH(s, COUNTER_PRUNED);
+      } else {
+        COUNT_SEARCH(s, COUNTER_EXPANDED);
+        search_path(s, cost + edge);
+      }
+      s->unvisited[w] |= 1ull << (i % SET_WORD_BITS);
+      p->size--;
+    }
+  }
+}
+
+/**
+ * Define search_path_N, uma versão de search_path especializada para grafos
+ * de exatamente N nós. Com N conhecido em tempo de compilação, o laço sobre os
+ * candidatos é desenrolado por completo e a máscara dos nós não visitados é
+ * passada por valor, podendo ficar em um registrador.
+ *
+ * @param N o número de nós no grafo
+ */
+#define DEFINE_SEARCH_KERNEL(N)                                                \
+  void search_path_##N(search *s, int size, unsigned int unvisited,            \
+                       int cost) {                                             \
+    path *p = s->current;                                                      \
+    weight *row = MATRIX_ROW(s->adj, p->nodes[size - 1]);                      \
+                                                                               \
+    if (size == N) {                                                           \
+      int edge = row[STARTING_NODE];                                           \
+      COUNT_SEARCH(s, COUNTER_LEAVES);                                         \
+      if (edge != MAX_COST) {                                                  \
+        p->nodes[N] = STARTING_NODE;                                           \
+        p->size = N + 1;                                                       \
+        record_search_path(s, cost + edge);                                    \
+      } else {                                                                 \
+        COUNT_SEARCH(s, COUNTER_INFEASIBLE);                                   \
+      }                                                                        \
+      return;                                                                  \
+    }                                                                          \
+                                                                               \
+    if (LEAF_SEARCH && N - size == LEAF_LEVELS) {                              \
+      int nodes[LEAF_LEVELS];                                                  \
+      unsigned int set = unvisited;                                            \
+      for (int k = 0; k < LEAF_LEVELS; k++, set &= set - 1) {                  \
+        nodes[k] = __builtin_ctz(set);                                         \
+      }                                                                        \
+      search_leaves(s, size, nodes, cost);                                     \
+      return;                                                                  \
+    }                                                                          \
+                                                                               \
+    _Pragma("GCC unroll 16") for (int i = 0; i < N; i++) {                     \
+      int edge = row[i];                                                       \
+      if (!(unvisited & (1u << i))) {                                          \
+        continue;                                                              \
+      } else if (edge == MAX_COST) {                                           \
+        COUNT_SEARCH(s, COUNTER_INFEASIBLE);                                   \
+        continue;                                                              \
+      } else if (s->best_cost != NULL &&                                       \
+                 cost + edge > get_best_cost(s->best_cost)) {                  \
+        COUNT_SEARCH(s, COUNTER_PRUNED);                                       \
+        continue;                                                              \
+      }                                                                        \
+                                                                               \
+      COUNT_SEARCH(s, COUNTER_EXPANDED);                                       \
+      p->nodes[size] = i;                                                      \
+      search_path_##N(s, size + 1, unvisited & ~(1u << i), cost + edge);       \
+    }                                                                          \
+  }
+
+DEFINE_SEARCH_KERNEL(1)
+DEFINE_SEARCH_KERNEL(2)
+DEFINE_SEARCH_KERNEL(3)
+DEFINE_SEARCH_KERNEL(4)
+DEFINE_SEARCH_KERNEL(5)
+DEFINE_SEARCH_KERNEL(6)
+DEFINE_SEARCH_KERNEL(7)
+DEFINE_SEARCH_KERNEL(8)
+DEFINE_SEARCH_KERNEL(9)
+DEFINE_SEARCH_KERNEL(10)
+DEFINE_SEARCH_KERNEL(11)
+DEFINE_SEARCH_KERNEL(12)
+DEFINE_SEARCH_KERNEL(13)
+DEFINE_SEARCH_KERNEL(14)
+DEFINE_SEARCH_KERNEL(15)
+DEFINE_SEARCH_KERNEL(16)
+
+// Os kernels especializados, indexados pelo número de nós do grafo
+search_kernel search_kernels[SPECIALIZED_MAX_SIZE + 1] = {
+    NULL,             search_path_1,  search_path_2,  search_path_3,
+    search_path_4,    search_path_5,  search_path_6,  search_path_7,
+    search_path_8,    search_path_9,  search_path_10, search_path_11,
+    search_path_12,   search_path_13, search_path_14, search_path_15,
+    search_path_16};
+
+/**
+ * Busca em profundidade a partir de s->current, com o kernel especializado
+ * para s->n se houver um, ou com search_path caso contrário. Com o limitante
+ * inferior, a busca começa por search_path, que o calcula.
+ *
+ * @param s o estado da busca
+ * @param cost o custo de s->current
+ *
+ * @returns void
+ */
+void start_search(search *s, int cost) {
+  if (s->bound == NULL && s->n >= 1 && s->n <= SPECIALIZED_MAX_SIZE) {
+    search_kernels[s->n](s, s->current->size, (unsigned int)s->unvisited[0],
+                         cost);
+  } else {
+    search_path(s, cost);
+  }
+}
+
+/**
+ * Resolve a subárvore da busca abaixo de prefix. Enquanto restarem levels
+ * níveis de divisão e a subárvore for grande o suficiente, cada filho de
+ * prefix vira uma tarefa OpenMP, que pode ser executada por qualquer thread
+ * ociosa do processo. Abaixo disso, a busca é sequencial. Os caminhos
+ * encontrados são registrados na lista da thread que executa a tarefa.
+ *
+ * @param ctx o estado compartilhado pelas tarefas do processo
+ * @param prefix os nós do caminho inicial da subárvore, que não são
+ * modificados
+ * @param size o número de nós em prefix
+ * @param levels o número de níveis abaixo de prefix que ainda podem ser
+ * divididos em tarefas
+ *
+ * @returns void
+ */
+void solve_subtree(task_context *ctx, int *prefix, int size, int levels) {
+  int thread = omp_get_thread_num();
+  int n = ctx->n;
+
+  search s;
+  s.n = n;
+  s.adj = ctx->adj;
+  s.current = new_path();
+  memcpy(s.current->nodes, prefix, size * sizeof(int));
+  s.current->size = size;
+  s.unvisited = new_unvisited_set(n, prefix, size);
+  s.best_cost = ctx->branch_and_bound ? &ctx->best_cost : NULL;
+  s.res = ctx->pll[thread];
+  s.counters = search_counters + (thread * COUNTERS);
+  s.bound = (ctx->bounds != NULL) ? ctx->bounds[thread] : NULL;
+  if (s.bound != NULL) {
+    reset_lower_bound(s.bound); // As designações são de outra subárvore
+  }
+
+  int cost = get_path_cost(s.current, ctx->adj);
+  if (cost == COST_INFINITE) {
+    COUNT_SEARCH(&s, COUNTER_INFEASIBLE);
+  } else if (s.best_cost != NULL && (cost > get_best_cost(s.best_cost) ||
+                                     exceeds_lower_bound(&s, cost))) {
+    COUNT_SEARCH(&s, COUNTER_PRUNED);
+  } else if (levels == 0 || n - size <= TASK_MIN_REMAINING) {
+    start_search(&s, cost);
+  } else {
+    weight *row = MATRIX_ROW(ctx->adj, prefix[size - 1]);
+    for (int w = 0; w < SET_WORDS(n); w++) {
+      unsigned long long candidates = s.unvisited[w];
+      while (candidates != 0) {
+        int i = (w * SET_WORD_BITS) + __builtin_ctzll(candidates);
+        candidates &= candidates - 1;
+
+        if (row[i] == MAX_COST) {
+          COUNT_SEARCH(&s, COUNTER_INFEASIBLE);
+          continue;
+        }
+        COUNT_SEARCH(&s, COUNTER_EXPANDED);
+
+        /* O prefixo do filho é copiado para fora da arena, já que a
+        tarefa pode ser executada por outra thread */
+        int *child = (int *)malloc((size + 1) * sizeof(int));
+        memcpy(child, prefix, size * sizeof(int));
+        child[size] = i;
+
+#pragma omp task firstprivate(child)
+        {
+          solve_subtree(ctx, child, size + 1, levels - 1);
+          free(child);
+        }
+      }
+    }
+  }
+
+  delete_unvisited_set(s.unvisited, n);
+  delete_path(s.current);
+}
+
+/**
+ * Resolve o problema para um dado n e uma lista de adjacências com o algoritmo
+ * de Held-Karp, distribuído entre os processos. A tabela é calculada camada
+ * por camada, em que cada camada contém os subconjuntos de nós visitados com o
+ * mesmo tamanho, e cada processo armazena apenas um bloco de cada camada.
+ * Todos os processos devem chamar essa função.
+ *
+ * @param n o número de nós no grafo
+ * @param adj a lista de adjacências do grafo, com os pesos
+ * @param world_size o número de processos
+ * @param rank o rank do processo
+ * @param res a path list onde a manager registra os caminhos de menor custo.
+ * Nos demais processos, ela não é modificada.
+ *
+ * @returns void
+ */
+void solve_problem_held_karp(int n, cost_matrix *adj, int world_size, int rank,
+                             path_list *res) {
+  path *p = new_path();
+  p->size = n + 1;
+  p->nodes[0] = STARTING_NODE;
+  p->nodes[n] = STARTING_NODE;
+
+  if (n == 0) { // Não há nenhum caminho
+    delete_path(p);
+    return;
+  }
+
+  if (n == 1) { // Só há o caminho trivial
+    if (rank == MANAGER_PROCESS_RANK) {
+      add_to_path_list(res, p, get_path_cost(p, adj));
+    }
+    delete_path(p);
+    return;
+  }
+
+  fill_binomials();
+  int m = n - 1;
+  held_karp_layer **layers =
+      (held_karp_layer **)malloc((m + 1) * sizeof(held_karp_layer *));
+
+  layers[1] = new_held_karp_layer(m, 1, world_size, rank);
+  compute_first_held_karp_layer(layers[1], adj);
+  for (int k = 2; k <= m; k++) {
+    layers[k] = new_held_karp_layer(m, k, world_size, rank);
+    compute_held_karp_layer(layers[k], layers[k - 1], adj, world_size);
+  }
+
+  // Fecha o ciclo de volta para STARTING_NODE no dono do conjunto completo
+  held_karp_layer *last_layer = layers[m];
+  held_karp_state *candidates =
+      (held_karp_state *)malloc(m * sizeof(held_karp_state));
+  int candidate_count = 0;
+  int local_min_cost = COST_INFINITE;
+  if (last_layer->count > 0) {
+    for (int j = 0; j < m; j++) {
+      int cost = last_layer->costs[j];
+      int edge = EDGE_COST(adj, held_karp_node(j), STARTING_NODE);
+      if (cost == COST_INFINITE || edge == MAX_COST) {
+        continue;
+      }
+
+      candidates[candidate_count].mask = last_layer->masks[0];
+      candidates[candidate_count].last = j;
+      candidates[candidate_count].cost = cost;
+      candidate_count++;
+      if (cost + edge < local_min_cost) {
+        local_min_cost = cost + edge;
+      }
+    }
+  }
+
+  int min_cost;
+  MPI_Allreduce(&local_min_cost, &min_cost, 1, MPI_INT, MPI_MIN,
+                MPI_COMM_WORLD);
+
+  int local_count = 0;
+  for (int i = 0; i < candidate_count; i++) {
+    int edge = EDGE_COST(adj, held_karp_node(candidates[i].last), STARTING_NODE);
+    if (candidates[i].cost + edge == min_cost) {
+      candidates[local_count++] = candidates[i];
+    }
+  }
+
+  // Estados ótimos de cada camada, da última para a primeira
+  held_karp_state **states =
+      (held_karp_state **)malloc((m + 1) * sizeof(held_karp_state *));
+  int *counts = (int *)malloc((m + 1) * sizeof(int));
+  states[m] =
+      gather_held_karp_states(candidates, local_count, &counts[m], world_size);
+  free(candidates);
+
+  for (int k = m; k > 1; k--) {
+    states[k - 1] = get_previous_held_karp_states(
+        states[k], counts[k], layers[k - 1], adj, &counts[k - 1], world_size);
+  }
+
+  if (rank == MANAGER_PROCESS_RANK) {
+    p->cost = min_cost;
+    for (int i = 0; i < counts[m]; i++) {
+      held_karp_collect(states, counts, adj, &states[m][i], m, p, res);
+    }
+  }
+
+  for (int k = 1; k <= m; k++) {
+    delete_held_karp_layer(layers[k]);
+    free(states[k]);
+  }
+  free(layers);
+  free(states);
+  free(counts);
+  delete_path(p);
+
+}
+
+/**
+ * Imprime a resposta, de acordo com o modo de saída
+ *
+ * @param stream o arquivo onde a resposta é impressa
+ * @param pl a path list da solução
+ * @param adj a matriz de adjacências do grafo
+ * @param opts as opções de execução
+ *
+ * @returns void
+ */
+void print_answer(FILE *stream, path_list *pl, cost_matrix *adj,
+                  options *opts) {
+  int cost = get_path_list_paths_cost(pl);
+
+  fprintf(stream, "Matriz de adjacências: \n");
+  print_matrix(stream, adj);
+
+  if (cost == PATH_LIST_EMPTY) {
+    fprintf(stream, "Nenhum caminho pôde ser encontrado\n");
+    return;
+  }
+
+  if (opts->output == OUTPUT_COUNT) {
+    fprintf(stream, "\n%lld caminhos encontrados, com custo %d\n", pl->count,
+            cost);
+    return;
+  }
+
+  if (opts->output == OUTPUT_STREAM) {
+    fprintf(stream,
+            "\n%lld caminhos encontrados, com custo %d, escritos em %s\n",
+            pl->count, cost, opts->output_file);
+    return;
+  }
 
-  for (int i = 0; i < num_paths; i++) {
-    path *p = new_path();
-    p->size = path_size;
-    for (int j = 0; j < path_size; j++) {
-      /*memcpy não pode ser utilizado aqui por conta da memória
-      alocada estaticamente (pl->paths[i]->nodes)*/
-      p->nodes[j] = spl[(path_size)*i + j];
-    }
-    concatenate_to_path_list(pl, p);
+  if (opts->output == OUTPUT_FIRST) {
+    fprintf(stream, "\n%lld caminhos encontrados, com custo %d. Um deles: \n",
+            pl->count, cost);
+  } else {
+    fprintf(stream, "\nCaminhos encontrados, com custo %d: \n", cost);
   }
 
-  return pl;
+  for (int i = 0; i < pl->size; i++) {
+    path *p = pl->paths[i];
+
+    print_path(stream, p);
+  }
 }
 
 /**
- * Junta duas path lists em uma, copindo os elementos da segunda e os
- * concatenando à primeira
+ * Junta os melhores caminhos de uma lista de path lists em res
  *
- * @param dest uma das path lists, onde o resultado ficará armazenado
- * @param other a outra path list, que terá seus paths copiados e concatenados a
- * dest
+ * @param pll uma lista de path lists
+ * @param pll_size o número de elementos na lista de path lists
+ * @param res a path list que recebe os melhores caminhos
  *
  * @returns void
  */
-void merge_path_lists(path_list *dest, path_list *other) {
-  for (int i = 0; i < other->size; i++) {
-    path *copy = copy_path(other->paths[i]);
-    concatenate_to_path_list(dest, copy);
+void get_final_answer(path_list **pll, int pll_size, path_list *res) {
+  for (int i = 0; i < pll_size; i++) {
+    merge_path_lists(res, pll[i]);
   }
 }
 
-/*
-********* Funções do problema principal *********
-*/
-
 /**
- * Gera uma matriz de custos para o grafo
+ * Resolve as tarefas da fila com as threads do processo. Cada thread retira
+ * uma tarefa por vez da fila e a divide em tarefas OpenMP menores, que as
+ * threads ociosas roubam umas das outras. Uma nova tarefa só é retirada da
+ * fila quando a anterior termina, para que as tarefas restantes continuem
+ * disponíveis aos outros processos. Na manager, quando há workers, uma das
+ * threads apenas distribui as tarefas. Com checkpoints, cada tarefa é
+ * resolvida inteira por uma thread, para que os seus caminhos sejam gravados
+ * separadamente (veja write_checkpoint).
  *
- * @param n o número de vértices do grafo
+ * @param n o número de nós no grafo
+ * @param adj a lista de adjacências do grafo, com os pesos
+ * @param q a fila de tarefas
+ * @param branch_and_bound se a poda por branch and bound está habilitada. O
+ * melhor custo conhecido é compartilhado por todas as threads do processo, e
+ * começa pelo da solução inicial (veja get_shared_warm_start_cost) ou pelo
+ * das tarefas retomadas de um checkpoint, se for menor.
+ * @param world_size o número de processos
+ * @param res a path list onde são registrados os caminhos de menor custo entre
+ * as tarefas resolvidas por esse processo, que pode já conter os das tarefas
+ * retomadas de um checkpoint. As listas de cada thread guardam os caminhos
+ * da mesma forma que ela, com um arquivo temporário próprio se ela escreve os
+ * caminhos em um arquivo.
  *
- * @returns a matriz de custos das arestas
+ * @returns void
  */
-int **get_cost_matrix(int n) {
-  int **matrix = new_square_matrix(n);
-  for (int i = 0; i < n; i++) {
-    for (int j = 0; j < n; j++) {
-      matrix[i][j] = rand() % (MAX_COST + 1);
+void solve_tasks(int n, cost_matrix *adj, task_queue *q, int branch_and_bound,
+                 int world_size, path_list *res) {
+  task_context ctx;
+  ctx.n = n;
+  ctx.adj = adj;
+  ctx.branch_and_bound = branch_and_bound;
+  ctx.pll = new_path_list_list(THREADS); // Os caminhos de cada thread
+  int known_cost = (res->count > 0) ? res->cost : COST_INFINITE;
+  ctx.best_cost =
+      branch_and_bound
+          ? get_shared_warm_start_cost(adj, known_cost, world_size, q->rank)
+          : COST_INFINITE;
+  ctx.bounds = branch_and_bound
+                   ? (lower_bound **)calloc(THREADS, sizeof(lower_bound *))
+                   : NULL;
+
+  arena **arenas = (arena **)malloc(THREADS * sizeof(arena *));
+  int thread_count = 0;
+  int dispatcher = (q->rank == MANAGER_PROCESS_RANK && world_size > 1);
+
+#pragma omp parallel num_threads(THREADS) copyin(max_path_size)
+  {
+    int thread = omp_get_thread_num();
+    if (thread == 0) {
+      thread_count = omp_get_num_threads();
+    }
+
+    /* Cada thread trabalha em uma arena própria, liberada de uma só vez
+    depois que a sua resposta é copiada para res */
+    arena *thread_arena = path_arena;
+    arenas[thread] = new_arena();
+    path_arena = arenas[thread];
+    ctx.pll[thread] = new_path_list();
+    ctx.pll[thread]->limit = res->limit;
+    ctx.pll[thread]->stream = (res->stream != NULL) ? tmpfile() : NULL;
+    if (ctx.bounds != NULL) {
+      ctx.bounds[thread] = new_lower_bound(adj);
     }
-    matrix[i][i] = 0;
+
+    // Todas as threads devem ter a sua lista antes de executar tarefas
+#pragma omp barrier
+
+    if (dispatcher && thread == 0) {
+      serve_task_requests(q, world_size, &ctx.best_cost);
+    } else {
+      path *p = new_path();
+
+      for (int task = get_next_task(q, &ctx.best_cost); task != NO_TASK;
+           task = get_next_task(q, &ctx.best_cost)) {
+        p->size = 0;
+        concatenate_to_path(p, STARTING_NODE);
+        for (int i = 0; i < q->depth; i++) {
+          concatenate_to_path(p, q->tasks[task * q->depth + i]);
+        }
+
+        if (q->checkpoint == NULL) {
+#pragma omp taskgroup
+          solve_subtree(&ctx, p->nodes, p->size, TASK_SPLIT_LEVELS);
+          continue;
+        }
+
+        /* A tarefa é resolvida sem divisão em uma lista própria, que é
+        gravada e depois juntada à da thread */
+        path_list *thread_res = ctx.pll[thread];
+        ctx.pll[thread] = new_path_list();
+        ctx.pll[thread]->limit = res->limit;
+        solve_subtree(&ctx, p->nodes, p->size, 0);
+        write_checkpoint(q, task, ctx.pll[thread], n);
+        merge_path_lists(thread_res, ctx.pll[thread]);
+        delete_path_list_paths(ctx.pll[thread]);
+        delete_path_list(ctx.pll[thread]);
+        ctx.pll[thread] = thread_res;
+      }
+
+      delete_path(p);
+    }
+
+    // As tarefas restantes são concluídas na barreira
+#pragma omp barrier
+    path_arena = thread_arena;
   }
 
-  return matrix;
+  double start = get_time();
+  get_final_answer(ctx.pll, thread_count, res);
+  phase_times[PHASE_MERGE] += get_time() - start;
+
+  for (int i = 0; i < thread_count; i++) {
+    if (ctx.pll[i]->stream != NULL) {
+      fclose(ctx.pll[i]->stream);
+    }
+    if (ctx.bounds != NULL) {
+      delete_lower_bound(ctx.bounds[i]);
+    }
+    delete_arena(arenas[i]);
+  }
+  free(arenas);
+  free(ctx.bounds);
+  arena_free(path_arena, ctx.pll, THREADS * sizeof(path_list *));
 }
 
 /**
- * Calcula o primeiro e o último nós pelos
- * quais esse processo deve seguir a DFS
+ * Envia a path list de um processo para outro, durante a redução das
+ * respostas. São enviados o número de caminhos guardados, o custo e o número
+ * de caminhos com esse custo, seguidos dos caminhos empacotados. Se a path
+ * list escreve os caminhos em um arquivo, ele é enviado se o outro processo
+ * pedir.
  *
- * @param start um ponteiro para a variável que armazenará o início
- * @param end um ponteiro para a fariável que armazenará o fim
- * @param world_size o número de processos em MPI_COMM_WORLD
- * @param rank o rank do processo em MPI_COMM_WORLD
- * @param n o número de cidades
+ * @param pl a path list
+ * @param n o número de nós no grafo
+ * @param dest o rank do processo que recebe a path list
  *
  * @returns void
  */
-void get_process_range(int *start, int *end, int world_size, int rank, int n) {
-  if (n > world_size) {
-    int chunk_size = (n - 1) / world_size;
+void send_path_list(path_list *pl, int n, int dest) {
+  long long header[3] = {pl->size, get_path_list_paths_cost(pl), pl->count};
+  MPI_Send(header, 3, MPI_LONG_LONG, dest, TAG_RESULT, MPI_COMM_WORLD);
 
-    if (rank == world_size - 1) {
-      *start = ((world_size - 1) * chunk_size) + 1;
-      *end = (n - 1);
-    } else {
-      *start = (rank * chunk_size) + 1;
-      *end = ((*start) + chunk_size) - 1;
+  unsigned char *spl = serialize_path_list(pl, n);
+  MPI_Send(spl, get_packed_path_size(n) * pl->size, MPI_BYTE, dest,
+           TAG_RESULT, MPI_COMM_WORLD);
+  free(spl);
+  gather_bytes_sent +=
+      sizeof(header) + (long long)get_packed_path_size(n) * pl->size;
+
+  if (pl->stream != NULL) {
+    int wanted;
+    MPI_Recv(&wanted, 1, MPI_INT, dest, TAG_RESULT, MPI_COMM_WORLD,
+             MPI_STATUS_IGNORE);
+    if (wanted) {
+      send_stream(pl->stream, dest);
     }
-  } else {
-    if (rank < n - 1) {
-      *start = rank + 1;
-      *end = *start;
-    } else { // Range inválida, não processa nada intencionalmente
-      *start = 1;
-      *end = 0;
+  }
+}
+
+/**
+ * Recebe a path list enviada por send_path_list e a junta a res, mantendo
+ * apenas os caminhos de menor custo. O arquivo do outro processo só é pedido
+ * se os seus caminhos tiverem custo menor ou igual aos de res.
+ *
+ * @param res a path list desse processo
+ * @param n o número de nós no grafo
+ * @param source o rank do processo que envia a path list
+ *
+ * @returns void
+ */
+void receive_path_list(path_list *res, int n, int source) {
+  long long header[3];
+  MPI_Recv(header, 3, MPI_LONG_LONG, source, TAG_RESULT, MPI_COMM_WORLD,
+           MPI_STATUS_IGNORE);
+
+  int num_paths = (int)header[0];
+  unsigned char *spl =
+      (unsigned char *)malloc((size_t)get_packed_path_size(n) * num_paths + 1);
+  MPI_Recv(spl, get_packed_path_size(n) * num_paths, MPI_BYTE, source,
+           TAG_RESULT, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+  gather_bytes_received +=
+      sizeof(header) + (long long)get_packed_path_size(n) * num_paths;
+
+  path_list *other = deserialize_path_list(spl, num_paths, n);
+  other->cost = (int)header[1];
+  other->count = header[2];
+  free(spl);
+
+  int wanted =
+      other->count > 0 && (res->count == 0 || other->cost <= res->cost);
+  merge_path_lists(res, other);
+
+  if (res->stream != NULL) {
+    MPI_Send(&wanted, 1, MPI_INT, source, TAG_RESULT, MPI_COMM_WORLD);
+    if (wanted) {
+      receive_stream(res->stream, source);
     }
   }
+
+  delete_path_list_paths(other);
+  delete_path_list(other);
 }
 
 /**
- * Resolve o problema para um dado n, uma lista de adjacências e o caminho
- * inicial. Esse algoritmo é uma busca em profundidade.
+ * Junta as respostas de todos os processos na manager, em uma redução em
+ * árvore binomial. A cada passo, metade dos processos restantes envia a sua
+ * path list a outro processo, que mantém apenas os caminhos de menor custo.
+ * Assim, cada processo recebe no máximo log2(world_size) listas, e a manager
+ * (que deve ser o rank 0) recebe apenas listas já reduzidas.
  *
+ * @param res a path list desse processo. Na manager, recebe a resposta final.
  * @param n o número de nós no grafo
- * @param adj a lista de adjacências do grafo, com os pesos
- * @param initial_path o caminho inicial. Esse caminho será deletado pela função
- * após utilizado.
+ * @param world_size o número de processos
+ * @param rank o rank do processo
  *
- * @returns uma lista de caminhos com o menor custo
+ * @returns void
  */
-path_list *solve_problem(int n, int **adj, path *initial_path) {
-  // printf("Solve problem chamado para o caminho: ");
-  // print_path(initial_path);
+void reduce_answers(path_list *res, int n, int world_size, int rank) {
+  double start = get_time();
 
-  if (initial_path->size == n) { // Caso base da recursão
-    concatenate_to_path(initial_path, STARTING_NODE);
-    path *res = copy_path(initial_path);
-    path_list *pl = new_path_list();
-    concatenate_to_path_list(pl, res);
-    return pl;
-  } else {
-    // Lista de caminhos visitados
-    int visited[MAX_GRAPH_SIZE];
-    for (int i = 0; i < MAX_GRAPH_SIZE; i++) {
-      visited[i] = 0;
+  for (int step = 1; step < world_size; step *= 2) {
+    if (rank & step) {
+      send_path_list(res, n, rank - step);
+      break;
     }
 
-    for (int i = 0; i < initial_path->size; i++) {
-      visited[initial_path->nodes[i]] = 1;
+    if (rank + step < world_size) {
+      receive_path_list(res, n, rank + step);
     }
+  }
 
-    path_list **pll =
-        new_path_list_list(n);  // Lista de todos os path lists gerados
-    int min_cost = __INT_MAX__; // Custo mínimo dos caminhos
+  phase_times[PHASE_GATHER] += get_time() - start;
+}
 
-    for (int i = 0; i < n; i++) {
+/*
+************* Utilidades para lotes *************
+*/
+
+/**
+ * Lê a próxima instância de uma lista de instâncias. Cada linha da lista é
+ * uma instância (veja get_batch_matrix). Linhas vazias e linhas que começam
+ * com '#' são ignoradas.
+ *
+ * @param list a lista de instâncias
+ * @param name onde a linha da instância é escrita, sem a quebra de linha, com
+ * até BATCH_MAX_LINE caracteres
+ *
+ * @returns 1 se uma instância foi lida, 0 se a lista terminou
+ */
+int read_batch_instance(FILE *list, char *name) {
+  while (fgets(name, BATCH_MAX_LINE, list) != NULL) {
+    name[strcspn(name, "\r\n")] = '\0';
+    if (name[0] != '\0' && name[0] != '#') {
+      return 1;
+    }
+  }
 
-      /* somente seguir com a geração da path list
-      a partir de um nó não visitado */
-      if (!visited[i]) {
-        path *p = copy_path(initial_path);
-        concatenate_to_path(p, i);
+  return 0;
+}
 
-        pll[i] = solve_problem(n, adj, p);
-        delete_path(p);
-      } else {
-        pll[i] = new_path_list(); //É uma path list vazia
+/**
+ * Obtém a matriz de uma instância de uma lista de instâncias, que pode ser
+ * um número de cidades, para uma matriz gerada aleatoriamente, ou o nome de
+ * um arquivo de matriz (veja read_cost_matrix)
+ *
+ * @param name a linha da instância
+ *
+ * @returns a matriz da instância, ou NULL se ela não pôde ser lida
+ */
+cost_matrix *get_batch_matrix(char *name) {
+  if (strspn(name, "0123456789") == strlen(name) && atoi(name) > 0) {
+    return get_cost_matrix(atoi(name));
+  }
+
+  return read_cost_matrix(name);
+}
+
+/**
+ * Cria o lote de instâncias de um processo
+ *
+ * @param list a lista de instâncias, na manager, ou NULL, nos workers
+ * @param rank o rank do processo
+ *
+ * @returns o lote alocado dinamicamente
+ */
+batch *new_batch(FILE *list, int rank) {
+  batch *b = (batch *)malloc(1 * sizeof(batch));
+  b->list = list;
+  b->ended = 0;
+  b->failed = 0;
+  b->count = 0;
+  b->printed = 0;
+  b->capacity = 0;
+  b->headers = NULL;
+  b->outputs = NULL;
+  b->exhausted = 0;
+  b->rank = rank;
+  return b;
+}
+
+/**
+ * Libera o espaço de um lote. Todas as respostas já devem ter sido impressas.
+ *
+ * @param b o lote a ser liberado
+ *
+ * @returns void
+ */
+void delete_batch(batch *b) {
+  free(b->headers);
+  free(b->outputs);
+  free(b);
+  b = NULL;
+}
+
+/**
+ * Registra a resposta de uma instância e imprime, na ordem da lista, todas as
+ * respostas que já podem ser impressas. Deve ser chamada dentro da seção
+ * crítica batch.
+ *
+ * @param b o lote
+ * @param index o índice da instância
+ * @param output a resposta da instância, que passa a pertencer ao lote
+ *
+ * @returns void
+ */
+void set_batch_output(batch *b, int index, char *output) {
+  b->outputs[index] = output;
+
+  while (b->printed < b->count && b->outputs[b->printed] != NULL) {
+    fputs(b->headers[b->printed], stdout);
+    fputs(b->outputs[b->printed], stdout);
+    free(b->headers[b->printed]);
+    free(b->outputs[b->printed]);
+    b->headers[b->printed] = NULL;
+    b->outputs[b->printed] = NULL;
+    b->printed++;
+  }
+}
+
+/**
+ * Lê a próxima instância da lista de um lote. Se a matriz de uma instância
+ * não puder ser lida, esse erro é registrado como a sua resposta e a
+ * instância seguinte é lida. Pode ser chamada por várias threads da manager
+ * ao mesmo tempo.
+ *
+ * @param b o lote da manager
+ * @param matrix onde a matriz da instância é escrita
+ *
+ * @returns o índice da instância, ou NO_TASK se a lista terminou
+ */
+int read_next_batch_instance(batch *b, cost_matrix **matrix) {
+  int index = NO_TASK;
+
+#pragma omp critical(batch)
+  {
+    char name[BATCH_MAX_LINE];
+    while (index == NO_TASK && !b->ended) {
+      if (!read_batch_instance(b->list, name)) {
+        b->ended = 1;
+        continue;
       }
 
-      // Obtém o custo mínimo dos caminhos possíveis
-      int cost = get_path_list_paths_cost(pll[i], adj);
-      if (cost != PATH_LIST_EMPTY && cost < min_cost) {
-        min_cost = cost;
+      if (b->count == b->capacity) {
+        b->capacity = (b->capacity > 0) ? 2 * b->capacity : BATCH_SIZE;
+        b->headers =
+            (char **)realloc(b->headers, b->capacity * sizeof(char *));
+        b->outputs =
+            (char **)realloc(b->outputs, b->capacity * sizeof(char *));
       }
-    }
 
-    path_list *res = new_path_list(); // A path list que armazena a resposta
+      int i = b->count++;
+      const char *format = "%sInstância %d: %s\n";
+      const char *separator = (i > 0) ? "\n" : "";
+      int header_size = snprintf(NULL, 0, format, separator, i, name) + 1;
+      b->headers[i] = (char *)malloc(header_size);
+      snprintf(b->headers[i], header_size, format, separator, i, name);
+      b->outputs[i] = NULL;
 
-    for (int i = 0; i < n; i++) {
-      if (get_path_list_paths_cost(pll[i], adj) == min_cost) {
-        merge_path_lists(res, pll[i]);
+      *matrix = get_batch_matrix(name);
+      if (*matrix != NULL) {
+        index = i;
+      } else {
+        b->failed = 1;
+        set_batch_output(b, i,
+                         strdup("A matriz da instância não pôde ser lida\n"));
       }
+    }
+  }
+
+  return index;
+}
 
-      delete_path_list_paths(pll[i]);
-      delete_path_list(pll[i]);
+/**
+ * Registra a resposta de uma instância resolvida. Pode ser chamada por várias
+ * threads da manager ao mesmo tempo.
+ *
+ * @param b o lote da manager
+ * @param index o índice da instância
+ * @param output a resposta da instância, que passa a pertencer ao lote
+ *
+ * @returns void
+ */
+void finish_batch_instance(batch *b, int index, char *output) {
+#pragma omp critical(batch)
+  set_batch_output(b, index, output);
+}
+
+/**
+ * Entrega a resposta da última instância resolvida pela thread que chama a
+ * função e obtém a próxima instância. Na manager, as instâncias são lidas
+ * diretamente da lista; nos workers, cada pedido à manager leva a resposta
+ * anterior, e a resposta ao pedido traz a matriz da próxima instância.
+ *
+ * @param b o lote do processo
+ * @param index o índice da última instância resolvida pela thread, ou NO_TASK
+ * @param output a resposta dessa instância, que é liberada ou passa a
+ * pertencer ao lote
+ * @param matrix onde a matriz da próxima instância é escrita
+ *
+ * @returns o índice da próxima instância, ou NO_TASK se não há mais
+ * instâncias
+ */
+int get_next_instance(batch *b, int index, char *output, cost_matrix **matrix) {
+  if (b->rank == MANAGER_PROCESS_RANK) {
+    if (index != NO_TASK) {
+      finish_batch_instance(b, index, output);
     }
+    return read_next_batch_instance(b, matrix);
+  }
 
-    free(pll);
+  int next = NO_TASK;
 
-    return res;
+#pragma omp critical(task_queue)
+  {
+    // Mesmo depois do fim da lista, as respostas pendentes são enviadas
+    if (!b->exhausted || index != NO_TASK) {
+      int output_size = (index != NO_TASK) ? strlen(output) : 0;
+      char *request = (char *)malloc(sizeof(int) + output_size);
+      memcpy(request, &index, sizeof(int));
+      if (output_size > 0) {
+        memcpy(request + sizeof(int), output, output_size);
+      }
+      MPI_Send(request, sizeof(int) + output_size, MPI_CHAR,
+               MANAGER_PROCESS_RANK, TAG_TASK_REQUEST, MPI_COMM_WORLD);
+      free(request);
+
+      int reply[2]; // O índice e o tamanho da próxima instância
+      MPI_Recv(reply, 2, MPI_INT, MANAGER_PROCESS_RANK, TAG_TASK,
+               MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+      next = reply[0];
+      if (next != NO_TASK) {
+        *matrix = new_matrix(reply[1]);
+        MPI_Recv((*matrix)->weights, reply[1] * (*matrix)->stride,
+                 MPI_WEIGHT, MANAGER_PROCESS_RANK, TAG_TASK, MPI_COMM_WORLD,
+                 MPI_STATUS_IGNORE);
+      }
+      b->exhausted = (next == NO_TASK);
+    }
   }
+
+  free(output);
+  return next;
 }
 
 /**
- * Resolve o problema para um dado n, uma lista de adjacências, o caminho
- * inicial e uma range definida por min e max. Esta é uma versão alterada de
- * solve_problem, que utiliza solve_problem para fazer a dfs apenas para alguns
- * caminhos específicos.
+ * Atende os pedidos de instâncias dos workers, até que todos tenham sido
+ * avisados de que a lista terminou e tenham enviado todas as respostas.
+ * Executada por uma thread da manager.
  *
- * @param n o número de nós no grafo
- * @param adj a lista de adjacências do grafo, com os pesos
- * @param initial_path o caminho inicial. Esse caminho será deletado pela função
- * após utilizado.
- * @param min o mínimo da range
- * @param max o máximo da range
+ * @param b o lote da manager
+ * @param world_size o número de processos
  *
- * @returns uma lista de caminhos com o menor custo
+ * @returns void
  */
-path_list *solve_problem_for_range(int n, int **adj, path *initial_path,
-                                   int min, int max) {
-  int range_size = (max - min) + 1;
+void serve_batch_requests(batch *b, int world_size) {
+  int *pending = (int *)calloc(world_size, sizeof(int));
+  int *exhausted = (int *)calloc(world_size, sizeof(int));
+  int finished_workers = 0;
 
-  path_list **pll =
-      new_path_list_list(range_size); // Lista de todos os path lists gerados
-  int min_cost = __INT_MAX__;         // Custo mínimo dos caminhos
+  while (finished_workers < world_size - 1) {
+    MPI_Status status;
+    int size;
+    MPI_Probe(MPI_ANY_SOURCE, TAG_TASK_REQUEST, MPI_COMM_WORLD, &status);
+    MPI_Get_count(&status, MPI_CHAR, &size);
+    int source = status.MPI_SOURCE;
 
-#pragma omp parallel for num_threads(THREADS) schedule(auto)
-  for (int i = min; i <= max; i++) {
-    int idx = i - min; // O índice de pll dessa resposta
+    char *request = (char *)malloc(size + 1);
+    MPI_Recv(request, size, MPI_CHAR, source, TAG_TASK_REQUEST,
+             MPI_COMM_WORLD, MPI_STATUS_IGNORE);
 
-    path *p = copy_path(initial_path);
-    concatenate_to_path(p, i);
+    int index;
+    memcpy(&index, request, sizeof(int));
+    if (index != NO_TASK) {
+      // A resposta é guardada no próprio espaço do pedido
+      int output_size = size - sizeof(int);
+      memmove(request, request + sizeof(int), output_size);
+      request[output_size] = '\0';
+      finish_batch_instance(b, index, request);
+      pending[source]--;
+    } else {
+      free(request);
+    }
 
-    pll[idx] = solve_problem(n, adj, p);
-    delete_path(p);
+    cost_matrix *matrix = NULL;
+    int reply[2];
+    reply[0] = read_next_batch_instance(b, &matrix);
+    reply[1] = (matrix != NULL) ? matrix->n : 0;
+    MPI_Send(reply, 2, MPI_INT, source, TAG_TASK, MPI_COMM_WORLD);
 
-    // Obtém o custo mínimo dos caminhos possíveis
-    int cost = get_path_list_paths_cost(pll[idx], adj);
-    if (cost != PATH_LIST_EMPTY && cost < min_cost) {
-      min_cost = cost;
+    if (matrix != NULL) {
+      MPI_Send(matrix->weights, matrix->n * matrix->stride, MPI_WEIGHT,
+               source, TAG_TASK, MPI_COMM_WORLD);
+      delete_matrix(matrix);
+      pending[source]++;
+    } else {
+      exhausted[source] = 1;
+    }
+
+    if (exhausted[source] && pending[source] == 0) {
+      finished_workers++;
     }
   }
 
-  path_list *res = new_path_list(); // A path list que armazena a resposta
+  free(pending);
+  free(exhausted);
+}
 
-  for (int i = 0; i < range_size; i++) {
-    if (get_path_list_paths_cost(pll[i], adj) == min_cost) {
-      merge_path_lists(res, pll[i]);
-    }
+/**
+ * Resolve uma instância inteira na thread que chama a função, com a busca
+ * em profundidade sequencial, e imprime a resposta
+ *
+ * @param adj a matriz de custos da instância
+ * @param opts as opções de execução
+ * @param stream o arquivo onde a resposta é impressa
+ *
+ * @returns void
+ */
+void solve_instance(cost_matrix *adj, options *opts, FILE *stream) {
+  int n = adj->n;
+  int best_cost =
+      opts->branch_and_bound ? get_warm_start_cost(adj, 0, 1) : COST_INFINITE;
+  long long counters[COUNTERS] = {0}; // Não são impressos no modo em lote
+  max_path_size = n + 1;
 
-    delete_path_list_paths(pll[i]);
-    delete_path_list(pll[i]);
-  }
+  search s;
+  s.n = n;
+  s.adj = adj;
+  s.current = new_path();
+  concatenate_to_path(s.current, STARTING_NODE);
+  s.unvisited = new_unvisited_set(n, s.current->nodes, s.current->size);
+  s.best_cost = opts->branch_and_bound ? &best_cost : NULL;
+  s.res = new_path_list();
+  s.counters = counters;
+  s.bound = opts->branch_and_bound ? new_lower_bound(adj) : NULL;
+  set_path_list_output(s.res, opts->output, NULL);
 
-  free(pll);
+  start_search(&s, 0);
+  print_answer(stream, s.res, adj, opts);
 
-  return res;
+  if (s.bound != NULL) {
+    delete_lower_bound(s.bound);
+  }
+  delete_path_list_paths(s.res);
+  delete_path_list(s.res);
+  delete_unvisited_set(s.unvisited, n);
+  delete_path(s.current);
 }
 
 /**
- * Imprime a resposta
+ * Resolve as instâncias de um lote. Cada instância é resolvida inteira por
+ * uma única thread de algum processo, que pede a próxima quando termina. As
+ * respostas são impressas pela manager na ordem da lista, e o custo de
+ * iniciar os processos é pago uma única vez para todas as instâncias. Na
+ * manager, quando há workers, uma das threads apenas distribui as instâncias.
  *
- * @param pl a path list da solução
- * @param adj a matriz de adjacências do grafo
- * @param n a ordem do grafo do problema
+ * @param b o lote do processo
+ * @param opts as opções de execução
+ * @param world_size o número de processos
  *
  * @returns void
  */
-void print_answer(path_list *pl, int **adj, int n) {
-  int cost = get_path_list_paths_cost(pl, adj);
+void solve_batch(batch *b, options *opts, int world_size) {
+  int dispatcher = (b->rank == MANAGER_PROCESS_RANK && world_size > 1);
 
-  printf("Matriz de adjacências: \n");
-  print_matrix(adj, n, n);
+#pragma omp parallel num_threads(THREADS)
+  {
+    arena *thread_arena = path_arena;
+    path_arena = new_arena();
 
-  if (cost == PATH_LIST_EMPTY) {
-    printf("Nenhum caminho pôde ser encontrado\n");
-    return;
-  }
+    if (dispatcher && omp_get_thread_num() == 0) {
+      serve_batch_requests(b, world_size);
+    } else {
+      cost_matrix *adj;
+      char *output = NULL;
+      size_t output_size;
 
-  printf("\nCaminhos encontrados, com custo %d: \n", cost);
-  for (int i = 0; i < pl->size; i++) {
-    path *p = pl->paths[i];
+      for (int index = get_next_instance(b, NO_TASK, NULL, &adj);
+           index != NO_TASK;
+           index = get_next_instance(b, index, output, &adj)) {
+        FILE *stream = open_memstream(&output, &output_size);
+        solve_instance(adj, opts, stream);
+        fclose(stream);
+        delete_matrix(adj);
+        arena_reset(path_arena);
+      }
+    }
 
-    print_path(p);
+    delete_arena(path_arena);
+    path_arena = thread_arena;
   }
 }
 
 /**
- * Obtém a lista dos melhores caminhos dada a matriz de custos
- * e uma lista de path lists
+ * Lê as opções de execução da linha de comando. O primeiro argumento é o
+ * número de cidades, que pode ser omitido quando a matriz é lida de um
+ * arquivo, seguido das flags opcionais:
  *
- * @param pll uma lista de path lists
- * @param pll_size o número de elementos na lista de path lists
- * @param costs a matriz de custos
- * @return uma lista com os melhores caminhos
- */
-path_list *get_final_answer(path_list **pll, int pll_size, int **costs) {
-  //  Determina o menor custo de um caminho
-  int min_cost = __INT_MAX__;
-#pragma omp parallel for num_threads(THREADS) schedule(auto)                   \
-    reduction(min                                                              \
-              : min_cost)
-  for (int i = 0; i < pll_size; i++) {
-    int cost = get_path_list_paths_cost(pll[i], costs);
-    if (cost != PATH_LIST_EMPTY && cost < min_cost) {
-      min_cost = cost;
-    }
+ * -i ARQUIVO: lê a matriz de custos de ARQUIVO (TSPLIB ou matriz binária), ao
+ * invés de gerá-la aleatoriamente. O número de cidades é o do arquivo.
+ * -l LISTA: resolve em lote as instâncias de LISTA ("-" para a entrada
+ * padrão), uma por linha, e imprime as respostas na ordem da lista
+ * -r SEMENTE: gera a matriz aleatória a partir de SEMENTE, ao invés do
+ * horário
+ * -t: imprime na saída de erro o tempo gasto em cada fase (veja
+ * print_phase_times)
+ * -e: imprime na saída de erro os contadores da busca, que devem ser
+ * habilitados na compilação com -DSEARCH_STATS
+ * -b: habilita a poda por branch and bound, pelo custo parcial e pelo
+ * limitantes inferiores (veja exceeds_lower_bound)
+ * -d: resolve o problema por programação dinâmica (Held-Karp), ao invés da
+ * busca em profundidade
+ * -s D: divide a busca em profundidade em tarefas com prefixos de D nós após
+ * o nó inicial, distribuídas sob demanda entre os processos e threads
+ * -c: imprime apenas o menor custo e o número de caminhos com esse custo
+ * -f: imprime apenas um dos caminhos de menor custo
+ * -w ARQUIVO: escreve os caminhos de menor custo em ARQUIVO, sem guardá-los na
+ * memória. Cada thread os escreve em um arquivo temporário à medida que são
+ * encontrados, e a manager junta os arquivos com o menor custo em ARQUIVO.
+ * -k ARQUIVO: grava em ARQUIVO.<rank> as tarefas resolvidas por cada
+ * processo, e retoma as de uma execução anterior com os mesmos ARQUIVO,
+ * matriz, -s e modo de saída, mesmo com outro número de processos
+ *
+ * @param argc o número de argumentos
+ * @param argv os argumentos
+ * @param opts as opções lidas
+ *
+ * @returns 0 se todas as opções são válidas, ou o índice em argv da primeira
+ * opção inválida
+ */
+int parse_options(int argc, char **argv, options *opts) {
+  opts->n = -1;
+  opts->branch_and_bound = 0;
+  opts->solver = SOLVER_DFS;
+  opts->split_depth = DEFAULT_SPLIT_DEPTH;
+  opts->output = OUTPUT_ALL;
+  opts->output_file = NULL;
+  opts->input_file = NULL;
+  opts->batch_file = NULL;
+  opts->seed = SEED_FROM_TIME;
+  opts->timing = 0;
+  opts->stats = 0;
+  opts->checkpoint_file = NULL;
+
+  int first = 1;
+  if (argc > 1 && argv[1][0] != '-') {
+    opts->n = atoi(argv[1]);
+    first = 2;
   }
 
-  path_list *res = new_path_list();
-  for (int i = 0; i < pll_size; i++) {
-    if (get_path_list_paths_cost(pll[i], costs) == min_cost) {
-      merge_path_lists(res, pll[i]);
+  for (int i = first; i < argc; i++) {
+    if (strcmp(argv[i], "-b") == 0) {
+      opts->branch_and_bound = 1;
+    } else if (strcmp(argv[i], "-d") == 0) {
+      opts->solver = SOLVER_HELD_KARP;
+    } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc &&
+               atoi(argv[i + 1]) > 0) {
+      opts->split_depth = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-c") == 0) {
+      opts->output = OUTPUT_COUNT;
+    } else if (strcmp(argv[i], "-f") == 0) {
+      opts->output = OUTPUT_FIRST;
+    } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+      opts->output = OUTPUT_STREAM;
+      opts->output_file = argv[++i];
+    } else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+      opts->input_file = argv[++i];
+    } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+      opts->batch_file = argv[++i];
+    } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc &&
+               argv[i + 1][0] >= '0' && argv[i + 1][0] <= '9') {
+      opts->seed = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-t") == 0) {
+      opts->timing = 1;
+    } else if (strcmp(argv[i], "-e") == 0) {
+      opts->stats = 1;
+    } else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+      opts->checkpoint_file = argv[++i];
+    } else {
+      return i;
     }
   }
 
-  return res;
+  return 0;
 }
 
 /**
@@ -674,45 +4765,100 @@ path_list *get_final_answer(path_list **pll, int pll_size, int **costs) {
  * @return int
  */
 int worker_main(int argc, char **argv) {
-  if (argc < 2)
-    return 0; // O erro já ocorre na manager
-
   int world_rank, world_size;
   MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
   MPI_Comm_size(MPI_COMM_WORLD, &world_size);
 
-  int n = atoi(argv[1]);
+  options opts;
+  if (parse_options(argc, argv, &opts) ||
+      (opts.n < 0 && opts.input_file == NULL && opts.batch_file == NULL) ||
+      (opts.batch_file != NULL &&
+       (opts.input_file != NULL || opts.solver == SOLVER_HELD_KARP ||
+        opts.output == OUTPUT_STREAM || opts.timing)) ||
+      (opts.stats &&
+       (opts.solver == SOLVER_HELD_KARP || opts.batch_file != NULL)) ||
+      (opts.checkpoint_file != NULL &&
+       (opts.solver == SOLVER_HELD_KARP || opts.batch_file != NULL ||
+        opts.output == OUTPUT_STREAM)))
+    return 0; // O erro já ocorre na manager
 
-  int seed;
-  MPI_Bcast(&seed, 1, MPI_INT, 0, MPI_COMM_WORLD);
-  srand(seed);
+#ifndef SEARCH_STATS
+  if (opts.stats)
+    return 0; // O erro já ocorre na manager
+#endif
+
+  if (opts.batch_file != NULL) {
+    int status; // NO_MATRIX se a manager não conseguiu abrir a lista
+    MPI_Bcast(&status, 1, MPI_INT, MANAGER_PROCESS_RANK, MPI_COMM_WORLD);
+    if (status == NO_MATRIX)
+      return 0; // O erro já ocorre na manager
+
+    batch *b = new_batch(NULL, world_rank);
+    solve_batch(b, &opts, world_size);
+    delete_batch(b);
+    return 0;
+  }
+
+  /* A matriz é gerada ou lida só pela manager, que envia o seu tamanho e
+  depois os pesos, já no formato contíguo */
+  int n;
+  MPI_Bcast(&n, 1, MPI_INT, MANAGER_PROCESS_RANK, MPI_COMM_WORLD);
+  if (n == NO_MATRIX ||
+      (opts.solver == SOLVER_HELD_KARP && n > HELD_KARP_MAX_SIZE) ||
+      (opts.solver == SOLVER_DFS &&
+       get_task_count(n, opts.split_depth) > MAX_TASKS))
+    return 0; // O erro já ocorre na manager
 
-  int **costs = get_cost_matrix(n);
+  max_path_size = n + 1;
 
-  int first, last;
-  get_process_range(&first, &last, world_size, world_rank, n);
+  cost_matrix *costs = new_matrix(n);
+  MPI_Bcast(costs->weights, n * costs->stride, MPI_WEIGHT,
+            MANAGER_PROCESS_RANK, MPI_COMM_WORLD);
 
-  path *initial_path = new_path();
-  concatenate_to_path(initial_path, STARTING_NODE);
+  if (opts.solver == SOLVER_HELD_KARP) {
+    path_list *res = new_path_list();
+    solve_problem_held_karp(n, costs, world_size, world_rank, res);
+    delete_path_list(res); // Vazia fora da manager
+    delete_matrix(costs);
+    return 0;
+  }
 
-  path_list *res = solve_problem_for_range(n, costs, initial_path, first, last);
+  // Os caminhos desse processo são escritos em um arquivo temporário
+  FILE *stream = (opts.output == OUTPUT_STREAM) ? tmpfile() : NULL;
+  path_list *res = new_path_list();
+  set_path_list_output(res, opts.output, stream);
 
-  int spl_size = (n + 1) * (res->size);
-  int *spl = serialize_path_list(res, n + 1);
+  task_queue *q = new_task_queue(n, opts.split_depth, world_rank);
+  if (opts.checkpoint_file != NULL) {
+    int status; // 1 se os checkpoints não são dessa instância
+    MPI_Bcast(&status, 1, MPI_INT, MANAGER_PROCESS_RANK, MPI_COMM_WORLD);
+    if (status) {
+      delete_task_queue(q);
+      delete_path_list(res);
+      delete_matrix(costs);
+      return 0; // O erro já ocorre na manager
+    }
+    open_checkpoint(q, opts.checkpoint_file, costs, opts.output);
+  }
 
-  // Enviando o tamanho da lista serializada em um gather
-  MPI_Gather(&spl_size, 1, MPI_INT, NULL, 1, MPI_INT, MANAGER_PROCESS_RANK,
-             MPI_COMM_WORLD);
+  solve_tasks(n, costs, q, opts.branch_and_bound, world_size, res);
+  if (q->checkpoint != NULL) {
+    close_checkpoint(q);
+  }
 
-  // Envia a lista serializada
-  MPI_Gatherv(spl, spl_size, MPI_INT, NULL, NULL, NULL, MPI_INT,
-              MANAGER_PROCESS_RANK, MPI_COMM_WORLD);
+  reduce_answers(res, n, world_size, world_rank);
 
-  free(spl);
-  delete_path(initial_path);
+  if (opts.stats) {
+    report_search_counters(THREADS, world_size, world_rank);
+  }
+
+  if (stream != NULL) {
+    fclose(stream);
+  }
+  delete_task_queue(q);
   delete_path_list_paths(res);
   delete_path_list(res);
-  delete_matrix(costs, n);
+  delete_matrix(costs);
 
   return 0;
 }
@@ -730,92 +4876,198 @@ int manager_main(int argc, char **argv) {
   MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
   MPI_Comm_size(MPI_COMM_WORLD, &world_size);
 
-  if (argc < 2) {
+  options opts;
+  int invalid = parse_options(argc, argv, &opts);
+  if (invalid) {
+    printf("Opção desconhecida: %s\n", argv[invalid]);
+    return 1;
+  }
+
+  if (opts.n < 0 && opts.input_file == NULL && opts.batch_file == NULL) {
     printf("O número de cidades não foi especificado. Execute o programa com "
-           "mpirun -np NP \"./pcv N\", onde NP é o número de processos e N o "
-           "número de cidades do problema.\n");
+           "mpirun -np NP \"./pcv N [-b] [-d] [-s D] [-k ARQUIVO] "
+           "[-c | -f | -w ARQUIVO]\", "
+           "onde NP é o número de processos e N o número de cidades do "
+           "problema, ou com mpirun -np NP \"./pcv -i ARQUIVO [...]\" para "
+           "ler a matriz de ARQUIVO, ou com mpirun -np NP \"./pcv -l LISTA "
+           "[...]\" para resolver em lote as instâncias de LISTA.\n");
+    return 1;
+  }
+
+  if (opts.batch_file != NULL &&
+      (opts.input_file != NULL || opts.solver == SOLVER_HELD_KARP ||
+       opts.output == OUTPUT_STREAM || opts.timing)) {
+    printf("A opção -l não pode ser usada com -i, -d, -w ou -t.\n");
     return 1;
   }
 
-  int n = atoi(argv[1]);
+  if (opts.stats &&
+      (opts.solver == SOLVER_HELD_KARP || opts.batch_file != NULL)) {
+    printf("A opção -e não pode ser usada com -d ou -l.\n");
+    return 1;
+  }
+
+  if (opts.checkpoint_file != NULL &&
+      (opts.solver == SOLVER_HELD_KARP || opts.batch_file != NULL ||
+       opts.output == OUTPUT_STREAM)) {
+    printf("A opção -k não pode ser usada com -d, -l ou -w.\n");
+    return 1;
+  }
 
-  if (n + 1 > MAX_GRAPH_SIZE) {
-    printf("O N passado é maior que o limite do programa. Isso pode ser "
-           "resolvido se modificando o macro MAX_GRAPH_SIZE, na linha 34, e "
-           "recompilando o programa. \n");
+#ifndef SEARCH_STATS
+  if (opts.stats) {
+    printf("Os contadores da busca não foram habilitados na compilação. "
+           "Recompile o programa com DEFINES=-DSEARCH_STATS no make.\n");
     return 1;
   }
+#endif
 
-  int seed = time(0);
-  MPI_Bcast(&seed, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  int seed = (opts.seed != SEED_FROM_TIME) ? opts.seed : time(0);
   srand(seed);
 
-  int **costs = get_cost_matrix(n);
+  if (opts.batch_file != NULL) {
+    FILE *list = (strcmp(opts.batch_file, "-") == 0)
+                     ? stdin
+                     : fopen(opts.batch_file, "r");
+    int status = (list != NULL) ? 0 : NO_MATRIX;
+    MPI_Bcast(&status, 1, MPI_INT, MANAGER_PROCESS_RANK, MPI_COMM_WORLD);
+    if (list == NULL) {
+      printf("Não foi possível abrir o arquivo %s.\n", opts.batch_file);
+      return 1;
+    }
+
+    batch *b = new_batch(list, world_rank);
+    solve_batch(b, &opts, world_size);
+    int failed = b->failed;
 
-  int first, last;
-  get_process_range(&first, &last, world_size, world_rank, n);
+    if (list != stdin) {
+      fclose(list);
+    }
+    delete_batch(b);
+
+    return failed;
+  }
 
-  path *initial_path = new_path();
-  concatenate_to_path(initial_path, STARTING_NODE);
+  // A matriz é lida ou gerada uma única vez, e enviada aos workers
+  double start = get_time();
+  cost_matrix *costs = (opts.input_file != NULL)
+                           ? read_cost_matrix(opts.input_file)
+                           : get_cost_matrix(opts.n);
+  int n = (costs != NULL) ? costs->n : NO_MATRIX;
+  MPI_Bcast(&n, 1, MPI_INT, MANAGER_PROCESS_RANK, MPI_COMM_WORLD);
+  if (costs == NULL) {
+    return 1;
+  }
 
-  path_list *res = solve_problem_for_range(n, costs, initial_path, first, last);
+  if (opts.solver == SOLVER_HELD_KARP && n > HELD_KARP_MAX_SIZE) {
+    printf("O Held-Karp suporta grafos de até %d cidades.\n",
+           HELD_KARP_MAX_SIZE);
+    delete_matrix(costs);
+    return 1;
+  }
 
-  int *spl = serialize_path_list(res, n + 1);
-  int spl_size = (n + 1) * res->size;
+  // Todos os processos criam a fila, então ela é verificada antes
+  if (opts.solver == SOLVER_DFS &&
+      get_task_count(n, opts.split_depth) > MAX_TASKS) {
+    printf("A opção -s %d divide a busca em mais de %d tarefas com %d "
+           "cidades. Use um D menor.\n",
+           opts.split_depth, MAX_TASKS, n);
+    delete_matrix(costs);
+    return 1;
+  }
 
-  int *sizes = (int *)malloc(world_size * sizeof(int));
-  MPI_Gather(&spl_size, 1, MPI_INT, sizes, 1, MPI_INT, MANAGER_PROCESS_RANK,
-             MPI_COMM_WORLD);
+  max_path_size = n + 1;
 
-  /* Calcular o tamanho dos caminhos serializados e os displacements
-  para o gatherv */
-  int serialized_paths_size = 0;
-  int *displacements = (int *)malloc(world_size * sizeof(int));
-  for (int i = 0; i < world_size; i++) {
-    serialized_paths_size += sizes[i];
-    displacements[i] = (i == 0) ? 0 : displacements[i - 1] + sizes[i - 1];
+  /* Os workers não sabem se o arquivo pôde ser aberto, então a execução é
+  abortada */
+  FILE *output_stream = NULL;
+  if (opts.output == OUTPUT_STREAM) {
+    output_stream = fopen(opts.output_file, "w+");
+    if (output_stream == NULL) {
+      printf("Não foi possível abrir o arquivo %s.\n", opts.output_file);
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
   }
 
-  // Obtêm as path lists de cada processo
-  int *serialized_paths = (int *)malloc(serialized_paths_size * sizeof(int));
-  memcpy(serialized_paths, spl, spl_size * sizeof(int));
-  MPI_Gatherv(MPI_IN_PLACE, 0, MPI_INT, serialized_paths, sizes, displacements,
-              MPI_INT, MANAGER_PROCESS_RANK, MPI_COMM_WORLD);
-  path_list **pll = new_path_list_list(world_size);
-  for (int i = 0; i < world_size; i++) {
-    pll[i] = deserialize_path_list(serialized_paths + displacements[i],
-                                   sizes[i], n + 1);
+  MPI_Bcast(costs->weights, n * costs->stride, MPI_WEIGHT,
+            MANAGER_PROCESS_RANK, MPI_COMM_WORLD);
+  phase_times[PHASE_GENERATION] = get_time() - start;
+
+  path_list *res = new_path_list();
+  set_path_list_output(res, opts.output, output_stream);
+
+  start = get_time();
+  if (opts.solver == SOLVER_HELD_KARP) {
+    solve_problem_held_karp(n, costs, world_size, world_rank, res);
+    phase_times[PHASE_SEARCH] = get_time() - start;
+  } else {
+    task_queue *q = new_task_queue(n, opts.split_depth, world_rank);
+    if (opts.checkpoint_file != NULL) {
+      // As tarefas já resolvidas são retomadas antes de abrir o checkpoint
+      int status = restore_checkpoints(q, opts.checkpoint_file, costs,
+                                       opts.output, res);
+      MPI_Bcast(&status, 1, MPI_INT, MANAGER_PROCESS_RANK, MPI_COMM_WORLD);
+      if (status) {
+        delete_task_queue(q);
+        delete_path_list_paths(res);
+        delete_path_list(res);
+        delete_matrix(costs);
+        return 1;
+      }
+      open_checkpoint(q, opts.checkpoint_file, costs, opts.output);
+    }
+
+    solve_tasks(n, costs, q, opts.branch_and_bound, world_size, res);
+    if (q->checkpoint != NULL) {
+      close_checkpoint(q);
+    }
+    // A junção das respostas das threads é medida à parte
+    phase_times[PHASE_SEARCH] =
+        get_time() - start - phase_times[PHASE_MERGE];
+
+    reduce_answers(res, n, world_size, world_rank);
+    delete_task_queue(q);
   }
 
-  // Libera memória não utilizada
-  free(sizes);
-  free(spl);
-  free(serialized_paths);
-  free(displacements);
-  delete_path(initial_path);
-  delete_path_list_paths(res);
-  delete_path_list(res);
+  start = get_time();
+  print_answer(stdout, res, costs, &opts);
+  phase_times[PHASE_OUTPUT] = get_time() - start;
 
-  path_list *final_res = get_final_answer(pll, world_size, costs);
+  if (opts.timing) {
+    print_phase_times(n, seed, world_size, THREADS);
+  }
 
-  print_answer(final_res, costs, n);
+  if (opts.stats) {
+    report_search_counters(THREADS, world_size, world_rank);
+  }
 
-  delete_path_list_list(pll, world_size);
-  delete_matrix(costs, n);
-  delete_path_list_paths(final_res);
-  delete_path_list(final_res);
+  if (output_stream != NULL) {
+    fclose(output_stream);
+  }
+  delete_path_list_paths(res);
+  delete_path_list(res);
+  delete_matrix(costs);
 
   return 0;
 }
 
 int main(int argc, char **argv) {
   THREADS = (THREADS != 0) ? THREADS : omp_get_max_threads();
-  MPI_Init(&argc, &argv);
+  /* Os pedidos de tarefas podem ser feitos por qualquer thread, mas nunca
+  por duas ao mesmo tempo */
+  int provided;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_SERIALIZED, &provided);
+  if (provided < MPI_THREAD_SERIALIZED) {
+    THREADS = 1;
+  }
 
   int world_rank;
   MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
 
   int return_value;
+  select_leaf_kernel();
+  path_arena = new_arena();
+  search_counters = (long long *)calloc(THREADS * COUNTERS, sizeof(long long));
 
   if (world_rank == MANAGER_PROCESS_RANK) {
     return_value = manager_main(argc, argv);
@@ -823,6 +5075,8 @@ int main(int argc, char **argv) {
     return_value = worker_main(argc, argv);
   }
 
+  delete_arena(path_arena);
+  free(search_counters);
   MPI_Finalize();
 
   return return_value;
@@ -9,30 +9,138 @@
  * executado com "make run-seq", com a entrada definida no próprio makefile
  */
 
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 /*
 ****** Constantes e definições de tipos ********
 */
 
+#ifndef MAX_COST // Pode ser redefinido na compilação, com -DMAX_COST=...
 #define MAX_COST                                                               \
   50 // Peso máximo de uma aresta. Quando uma aresta tem esse peso, o custo
      // dessa aresta é considerado infinito (aresta inexistente).
-#define MAX_GRAPH_SIZE 15                  // Tamanho maximo do grafo
-#define MAX_PATH_SIZE (MAX_GRAPH_SIZE + 1) // Tamanho máximo de um caminho
+#endif
+#define HELD_KARP_MAX_SIZE 32 // Tamanho máximo do grafo no Held-Karp, cujos
+                              // subconjuntos são máscaras de 32 bits
+#define SET_WORD_BITS 64 // Número de nós em cada palavra de um conjunto
+// O número de palavras de um conjunto de n nós
+#define SET_WORDS(n) (((n) + SET_WORD_BITS - 1) / SET_WORD_BITS)
+#define SPECIALIZED_MAX_SIZE 16 // Maior grafo com um kernel de busca próprio
 #define STARTING_NODE 0
-#define COST_NOT_COMPUTED 0
+#define COST_NOT_COMPUTED -1
 #define COST_INFINITE __INT_MAX__
-#define PATH_LIST_SIZE 32
+#define PATH_LIST_SIZE 4 // Capacidade inicial de uma path list
 #define PATH_LIST_EMPTY -1
+#define PATH_LIST_UNLIMITED -1 // Path list que guarda todos os caminhos
+#define STREAM_CHUNK_SIZE 4096 // Tamanho dos blocos copiados entre arquivos
+#define SOLVER_DFS 0       // Busca em profundidade
+#define SOLVER_HELD_KARP 1 // Programação dinâmica de Held-Karp
+#define OUTPUT_ALL 0       // Imprime todos os caminhos de menor custo
+#define OUTPUT_COUNT 1     // Imprime só o menor custo e o número de caminhos
+#define OUTPUT_FIRST 2     // Imprime só um dos caminhos de menor custo
+#define OUTPUT_STREAM 3    // Escreve os caminhos em um arquivo ao encontrá-los
+#define CACHE_LINE_SIZE 64 // Tamanho de uma linha de cache, em bytes
+#define ARENA_CHUNK_SIZE (64 * 1024) // Tamanho mínimo de um bloco de uma arena
+#define ARENA_SMALL_CLASSES 64       // Classes de tamanho de 16 em 16 bytes
+#define ARENA_SIZE_CLASSES 96        // Total de classes de tamanho
+#define TSPLIB_MAX_LINE 256 // Tamanho máximo de uma linha de um arquivo TSPLIB
+#define TSPLIB_MAX_VALUE 31 // Tamanho máximo de um valor de palavra-chave
+#define TSPLIB_PI 3.141592  // Valor de pi da especificação do TSPLIB
+#define TSPLIB_EARTH_RADIUS 6378.388 // Raio da Terra, em km, no tipo GEO
+#define BINARY_MATRIX_MAGIC "PCVMATRX" // Início de uma matriz binária
+#define BINARY_MATRIX_MAGIC_SIZE 8     // Tamanho de BINARY_MATRIX_MAGIC
+#define BINARY_MATRIX_HEADER_SIZE 64   // Tamanho do cabeçalho da matriz binária
+#define BATCH_MAX_LINE 1024 // Tamanho máximo de uma linha de uma lista
+#define PHASE_GENERATION 0 // Geração ou leitura e distribuição da matriz
+#define PHASE_SEARCH 1     // Busca dos caminhos de menor custo
+#define PHASE_GATHER 2     // Coleta das respostas dos processos
+#define PHASE_MERGE 3      // Junção das respostas das threads
+#define PHASE_OUTPUT 4     // Impressão da resposta
+#define PHASES 5           // Número de fases medidas
+#define SEED_FROM_TIME -1  // Semente gerada a partir do horário
+#define COUNTER_EXPANDED 0   // Nós expandidos (caminhos parciais estendidos)
+#define COUNTER_LEAVES 1     // Caminhos com todos os nós alcançados
+#define COUNTER_INFEASIBLE 2 // Ramos descartados por arestas inexistentes
+#define COUNTER_PRUNED 3     // Ramos podados pelo branch and bound
+#define COUNTER_TIES 4       // Caminhos com o custo do melhor já encontrado
+#define COUNTERS 5           // Número de contadores da busca
+#define BOUND_MIN_REMAINING 6 // Nós restantes abaixo dos quais o limitante
+                              // inferior não é calculado
+#define BOUND_ITERATIONS 3    // Iterações do subgradiente em cada limitante
+#define BOUND_STEP 2.0        // Fator do passo do subgradiente
+#define BOUND_EPSILON 1e-6    // Folga dos erros de arredondamento na poda
+#define LEAF_LEVELS 4         // Níveis finais avaliados de uma só vez
+#define LEAF_PERMUTATIONS 24  // Ordens dos nós dos níveis finais (4!)
+#define LEAF_MISSING (1 << 26) // Custo de uma aresta inexistente nas folhas
+// O cabeçalho da tabela impressa por print_counters_row
+#define COUNTERS_HEADER                                                        \
+  "  rank  thread   expandidos       folhas    inviáveis        podas      "   \
+  "empates"
 
-typedef struct _path {      // Um caminho
-  int nodes[MAX_PATH_SIZE]; // Os nós no caminho
-  int cost;                 // Custo do caminho até então
-  int size;                 // Número de nós no caminho
+// Incrementa um contador da busca, se eles foram habilitados na compilação
+#ifdef SEARCH_STATS
+#define COUNT_SEARCH(s, counter) ((s)->counters[counter]++)
+#else
+#define COUNT_SEARCH(s, counter) ((void)0)
+#endif
+
+/* Os níveis finais só são avaliados de uma só vez se as somas de
+LEAF_LEVELS + 1 arestas, inexistentes ou não, cabem em um int */
+#if MAX_COST <= USHRT_MAX
+#define LEAF_SEARCH 1
+#else
+#define LEAF_SEARCH 0
+#endif
+
+// O peso de uma aresta, no menor tipo que comporta MAX_COST
+#if MAX_COST <= UCHAR_MAX
+typedef unsigned char weight;
+#elif MAX_COST <= USHRT_MAX
+typedef unsigned short weight;
+#else
+typedef int weight;
+#endif
+
+typedef struct _cost_matrix { // Uma matriz de custos contígua, linha a linha
+  weight *weights;            // Os pesos das arestas
+  int n;                      // O número de linhas e colunas
+  int stride;                 // A distância entre o início de duas linhas
+  void *mapping;       // O arquivo mapeado em memória que contém os pesos,
+                       // ou NULL se os pesos foram alocados
+  size_t mapping_size; // O tamanho do mapeamento, em bytes
+} cost_matrix;
+
+typedef struct _binary_matrix_header { // O cabeçalho de uma matriz binária,
+                                       // estendido com zeros até
+                                       // BINARY_MATRIX_HEADER_SIZE bytes
+  char magic[BINARY_MATRIX_MAGIC_SIZE]; // BINARY_MATRIX_MAGIC
+  int n;                                // O número de linhas e colunas
+  int weight_size; // O tamanho de cada peso, em bytes (1, 2 ou 4)
+  int stride;      // O número de pesos entre o início de duas linhas
+} binary_matrix_header;
+
+// A linha i da matriz
+#define MATRIX_ROW(matrix, i)                                                  \
+  ((matrix)->weights + (size_t)(i) * (matrix)->stride)
+// O custo da aresta (i, j) da matriz
+#define EDGE_COST(matrix, i, j) (MATRIX_ROW(matrix, i)[j])
+
+typedef struct _path { // Um caminho
+  int cost;            // Custo do caminho até então
+  int size;            // Número de nós no caminho
+  int nodes[];         // Os nós no caminho, com espaço para max_path_size nós
 } path;
 
 typedef struct _path_list { // Uma lista de caminhos alocados dinamicamente. Os
@@ -41,50 +149,175 @@ typedef struct _path_list { // Uma lista de caminhos alocados dinamicamente. Os
   path **paths;
   int size;
   int _actual_size;
+  path *_initial_paths[PATH_LIST_SIZE]; // Espaço inicial de paths, para que
+                                        // listas pequenas não façam alocações
+  int cost;        // O custo dos caminhos, se count > 0
+  long long count; // O número de caminhos com esse custo, guardados ou não
+  int limit;       // Máximo de caminhos guardados, ou PATH_LIST_UNLIMITED
+  FILE *stream;    // Se não for NULL, os caminhos são escritos nesse arquivo
+                   // ao invés de guardados
 } path_list;
 
+typedef struct _assignment { // Uma solução do problema de designação dos
+                             // nós restantes de um caminho (veja
+                             // get_assignment_bound). Os vetores ficam em um
+                             // único bloco de 4n + 2 inteiros, a partir de
+                             // successors.
+  int *successors;        // O sucessor de cada nó, ou -1
+  int *predecessors;      // O antecessor de cada nó, ou -1, mais o da coluna
+                          // virtual n, usada em augment_assignment
+  int *row_potentials;    // As variáveis duais das linhas (nós de origem)
+  int *column_potentials; // As variáveis duais das colunas, mais a virtual
+  int solved; // Se a solução corresponde ao caminho atual com esse tamanho
+} assignment;
+
+typedef struct _lower_bound { // Os limitantes inferiores de uma busca: o do
+                              // problema de designação e o 1-tree, com as
+                              // penalidades lagrangianas dos nós
+  int n;                      // O número de nós no grafo
+  assignment *assignments;    // A solução da designação de cada tamanho do
+                              // caminho, de 0 a n
+  int *columns;               // As colunas da designação
+  int *slacks;                // A menor folga de cada coluna
+  int *ways;                  // A coluna anterior a cada coluna no caminho
+                              // aumentante
+  int *used;                  // Se cada coluna já está no caminho aumentante
+  int *costs;         // A matriz n x n do menor custo entre os dois sentidos
+                      // de cada aresta, ou COST_INFINITE se não há nenhum
+  double *penalties;  // A penalidade de cada nó, refinada a cada cálculo
+  int *nodes;         // Os nós não visitados
+  int *parents;       // O pai de cada nó na árvore geradora mínima, ou -1
+                      // depois que o nó é adicionado a ela
+  int *degrees;       // O grau de cada nó na 1-tree
+  double *distances;  // A menor distância de cada nó até a árvore
+} lower_bound;
+
+typedef struct _search { // O estado de uma busca em profundidade
+  int n;                 // O número de nós no grafo
+  cost_matrix *adj;      // A matriz de adjacências do grafo
+  path *current;         // O caminho atual, modificado no lugar pela busca
+  unsigned long long *unvisited; // Máscara dos nós ainda não visitados, com
+                                 // SET_WORDS(n) palavras
+  int *best_cost;               // O melhor custo conhecido, ou NULL
+  path_list *res;               // Os caminhos de menor custo encontrados
+  long long *counters;          // Os contadores da busca (COUNTER_*)
+  lower_bound *bound; // O limitante inferior usado na poda, ou NULL
+} search;
+
+// Um kernel de busca especializado para um número fixo de nós
+typedef void (*search_kernel)(search *s, int size, unsigned int unvisited,
+                              int cost);
+
+// Uma implementação de evaluate_leaves, para um conjunto de instruções
+typedef unsigned int (*leaf_kernel)(const int *edges, int *minimum);
+
+typedef struct _arena_chunk { // Um bloco de memória de uma arena
+  struct _arena_chunk *next;  // O próximo bloco da arena
+  size_t used;                // Número de bytes já utilizados
+  size_t capacity;            // Número de bytes do bloco
+  _Alignas(16) char data[];   // A memória do bloco
+} arena_chunk;
+
+typedef struct _arena { // Um alocador que reserva memória em blocos grandes e
+                        // libera tudo de uma só vez. Espaços liberados
+                        // individualmente são reaproveitados por tamanho.
+  arena_chunk *chunks;  // A lista de blocos da arena
+  arena_chunk *current; // O bloco onde ocorrem as próximas alocações
+  void *free_lists[ARENA_SIZE_CLASSES]; // Espaços liberados, por tamanho
+} arena;
+
+typedef struct _options { // Opções de execução lidas da linha de comando
+  int n;                  // Número de cidades
+  int branch_and_bound;   // Se a poda por branch and bound está habilitada
+  int solver;             // O algoritmo (SOLVER_DFS ou SOLVER_HELD_KARP)
+  int output;             // O modo de saída (OUTPUT_*)
+  char *output_file;      // O arquivo de saída do modo OUTPUT_STREAM
+  char *input_file;       // O arquivo da matriz de custos, ou NULL para
+                          // gerar uma matriz aleatória
+  char *batch_file;       // A lista de instâncias do modo em lote, ou NULL
+  int seed;               // A semente da matriz aleatória, ou SEED_FROM_TIME
+  int timing;             // Se o tempo de cada fase deve ser impresso
+  int stats;              // Se os contadores da busca devem ser impressos
+} options;
+
+// O número máximo de nós em um caminho (n + 1), definido em tempo de execução
+int max_path_size = 0;
+
+// O tempo gasto em cada fase da execução, em segundos
+double phase_times[PHASES];
+
+// O nome de cada fase, como impresso por print_phase_times
+const char *phase_names[PHASES] = {"generation", "search", "gather", "merge",
+                                   "output"};
+
+// Os contadores da busca (COUNTER_*)
+long long search_counters[COUNTERS];
+
+// A arena onde são alocados os paths e path lists
+arena *path_arena = NULL;
+
+// As ordens dos LEAF_LEVELS nós dos níveis finais, em ordem lexicográfica
+int leaf_permutations[LEAF_PERMUTATIONS][LEAF_LEVELS];
+
+/* A posição em edges (veja search_leaves) da k-ésima aresta de cada ordem,
+alinhada para as leituras vetoriais */
+_Alignas(32) int leaf_edges[LEAF_LEVELS + 1][LEAF_PERMUTATIONS];
+
 /*
 *********** Utilidades para matrizes ***********
 */
 
 /**
- * Aloca dinamicamente uma matriz
+ * Calcula a distância entre o início de duas linhas de uma matriz. Cada
+ * linha é estendida até um múltiplo de CACHE_LINE_SIZE bytes.
  *
- * @param n o número de linhas da matriz
- * @param m o número de colunas da matriz
+ * @param n o número de colunas
  *
- * @return a matriz alocada
+ * @returns o número de pesos entre o início de duas linhas
  */
-int **new_matrix(int n, int m) {
-  int **matrix = (int **)malloc(n * sizeof(int *));
-  for (int i = 0; i < n; i++) {
-    matrix[i] = (int *)malloc(m * sizeof(int));
-  }
-
-  return matrix;
+int get_matrix_stride(int n) {
+  int row_size = n * sizeof(weight);
+  row_size = ((row_size + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE) *
+             CACHE_LINE_SIZE;
+  return row_size / sizeof(weight);
 }
 
 /**
- * Aloca dinamicamente uma matriz quadrada
- * (mesmo número de linhas e colunas)
+ * Aloca dinamicamente uma matriz quadrada contígua, guardada linha a linha.
+ * Cada linha é estendida até um múltiplo de CACHE_LINE_SIZE bytes, e a
+ * matriz começa no início de uma linha de cache, de forma que uma linha
+ * da matriz ocupe o menor número possível de linhas de cache.
  *
  * @param n o número de linhas e colunas
  *
  * @returns a matriz alocada
  */
-int **new_square_matrix(int n) { return new_matrix(n, n); }
+cost_matrix *new_matrix(int n) {
+  cost_matrix *matrix = (cost_matrix *)malloc(1 * sizeof(cost_matrix));
+
+  matrix->n = n;
+  matrix->stride = get_matrix_stride(n);
+  matrix->mapping = NULL;
+  matrix->mapping_size = 0;
+  size_t size = (n > 0) ? (size_t)n * matrix->stride * sizeof(weight)
+                        : CACHE_LINE_SIZE;
+  matrix->weights = (weight *)aligned_alloc(CACHE_LINE_SIZE, size);
+  memset(matrix->weights, 0, size);
+  return matrix;
+}
 
 /**
  * Libera o espaço utilizado por uma matriz
  *
  * @param matrix a matriz a ser liberada
- * @param n o número de linhas da matriz
  *
  * @returns void
  */
-void delete_matrix(int **matrix, int n) {
-  for (int i = 0; i < n; i++) {
-    free(matrix[i]);
+void delete_matrix(cost_matrix *matrix) {
+  if (matrix->mapping != NULL) {
+    munmap(matrix->mapping, matrix->mapping_size);
+  } else {
+    free(matrix->weights);
   }
   free(matrix);
   matrix = NULL;
@@ -93,34 +326,535 @@ void delete_matrix(int **matrix, int n) {
 /**
  * Imprime uma matriz, para fins de debug
  *
+ * @param stream o arquivo onde a matriz é impressa
  * @param matrix a matriz a ser impressa
- * @param n o número de linhas da matriz
- * @param m o número de colunas da matriz
  *
  * @returns void
  */
-void print_matrix(int **matrix, int n, int m) {
+void print_matrix(FILE *stream, cost_matrix *matrix) {
+  for (int i = 0; i < matrix->n; i++) {
+    weight *row = MATRIX_ROW(matrix, i);
+    for (int j = 0; j < matrix->n; j++) {
+      fprintf(stream, "%02d ", row[j]);
+    }
+    fprintf(stream, "\n");
+  }
+  fprintf(stream, "\n");
+}
+
+/*
+****** Utilidades para leitura de arquivos ******
+*/
+
+/**
+ * Lê o valor de uma palavra-chave de um arquivo TSPLIB, no formato
+ * "PALAVRA : VALOR" ou "PALAVRA: VALOR"
+ *
+ * @param line a linha do arquivo
+ * @param value onde o valor é escrito, com até TSPLIB_MAX_VALUE caracteres
+ *
+ * @returns void
+ */
+void read_tsplib_value(char *line, char *value) {
+  char *start = strchr(line, ':');
+  value[0] = '\0';
+  if (start != NULL) {
+    sscanf(start + 1, " %31s", value);
+  }
+}
+
+/**
+ * Verifica se a entrada (i, j) de uma matriz aparece em uma seção
+ * EDGE_WEIGHT_SECTION de um arquivo TSPLIB, que é lida linha a linha
+ *
+ * @param format o formato da seção (EDGE_WEIGHT_FORMAT)
+ * @param i a linha da entrada
+ * @param j a coluna da entrada
+ *
+ * @returns 1 se a entrada aparece no arquivo, 0 caso contrário
+ */
+int is_tsplib_entry(char *format, int i, int j) {
+  if (strcmp(format, "FULL_MATRIX") == 0) {
+    return 1;
+  } else if (strcmp(format, "UPPER_ROW") == 0) {
+    return j > i;
+  } else if (strcmp(format, "LOWER_ROW") == 0) {
+    return j < i;
+  } else if (strcmp(format, "UPPER_DIAG_ROW") == 0) {
+    return j >= i;
+  } else {
+    return j <= i; // LOWER_DIAG_ROW
+  }
+}
+
+/**
+ * Converte uma coordenada do tipo GEO do TSPLIB (graus.minutos) em radianos
+ *
+ * @param coordinate a coordenada
+ *
+ * @returns a coordenada em radianos
+ */
+double get_tsplib_radians(double coordinate) {
+  double degrees = (int)coordinate;
+  double minutes = coordinate - degrees;
+  return TSPLIB_PI * (degrees + 5.0 * minutes / 3.0) / 180.0;
+}
+
+/**
+ * Calcula a distância entre duas cidades de um arquivo TSPLIB, com as
+ * fórmulas da especificação do formato
+ *
+ * @param type o tipo das distâncias (EDGE_WEIGHT_TYPE)
+ * @param x as primeiras coordenadas das cidades
+ * @param y as segundas coordenadas das cidades
+ * @param i a primeira cidade
+ * @param j a segunda cidade
+ *
+ * @returns a distância entre as cidades
+ */
+long long get_tsplib_distance(char *type, double *x, double *y, int i, int j) {
+  double dx = x[i] - x[j];
+  double dy = y[i] - y[j];
+
+  if (strcmp(type, "ATT") == 0) {
+    double r = sqrt((dx * dx + dy * dy) / 10.0);
+    long long t = (long long)(r + 0.5);
+    return (t < r) ? t + 1 : t;
+  } else if (strcmp(type, "GEO") == 0) {
+    double latitude_i = get_tsplib_radians(x[i]);
+    double longitude_i = get_tsplib_radians(y[i]);
+    double latitude_j = get_tsplib_radians(x[j]);
+    double longitude_j = get_tsplib_radians(y[j]);
+    double q1 = cos(longitude_i - longitude_j);
+    double q2 = cos(latitude_i - latitude_j);
+    double q3 = cos(latitude_i + latitude_j);
+    return (long long)(TSPLIB_EARTH_RADIUS *
+                           acos(0.5 * ((1.0 + q1) * q2 - (1.0 - q1) * q3)) +
+                       1.0);
+  } else {
+    return (long long)(sqrt(dx * dx + dy * dy) + 0.5); // EUC_2D
+  }
+}
+
+/**
+ * Verifica se um peso lido de um arquivo cabe na matriz de custos
+ *
+ * @param w o peso
+ * @param filename o nome do arquivo, para a mensagem de erro
+ *
+ * @returns 0 se o peso for válido, 1 caso contrário
+ */
+int check_file_weight(long long w, char *filename) {
+  if (w < 0 || w > MAX_COST) {
+    printf("O arquivo %s tem o peso %lld, fora do intervalo [0, %d]. "
+           "Recompile o programa com um MAX_COST maior (ex.: com "
+           "DEFINES=-DMAX_COST=65535 no make).\n",
+           filename, w, MAX_COST);
+    return 1;
+  }
+
+  return 0;
+}
+
+/**
+ * Lê uma matriz de custos de um arquivo no formato TSPLIB. São suportados
+ * os tipos EXPLICIT (nos formatos FULL_MATRIX, UPPER_ROW, LOWER_ROW,
+ * UPPER_DIAG_ROW e LOWER_DIAG_ROW), EUC_2D, ATT e GEO.
+ *
+ * @param filename o nome do arquivo
+ * @param file o arquivo, já aberto
+ *
+ * @returns a matriz de custos, ou NULL em caso de erro
+ */
+cost_matrix *read_tsplib_matrix(char *filename, FILE *file) {
+  char line[TSPLIB_MAX_LINE];
+  char keyword[TSPLIB_MAX_VALUE + 1];
+  char type[TSPLIB_MAX_VALUE + 1] = "EXPLICIT";
+  char format[TSPLIB_MAX_VALUE + 1] = "FULL_MATRIX";
+  int n = 0;
+
+  while (fgets(line, TSPLIB_MAX_LINE, file) != NULL) {
+    keyword[0] = '\0';
+    sscanf(line, " %31[A-Z_0-9]", keyword);
+
+    if (strcmp(keyword, "DIMENSION") == 0) {
+      char value[TSPLIB_MAX_VALUE + 1];
+      read_tsplib_value(line, value);
+      n = atoi(value);
+    } else if (strcmp(keyword, "EDGE_WEIGHT_TYPE") == 0) {
+      read_tsplib_value(line, type);
+    } else if (strcmp(keyword, "EDGE_WEIGHT_FORMAT") == 0) {
+      read_tsplib_value(line, format);
+    } else if (strcmp(keyword, "NODE_COORD_SECTION") == 0 ||
+               strcmp(keyword, "EDGE_WEIGHT_SECTION") == 0 ||
+               strcmp(keyword, "EOF") == 0) {
+      break;
+    }
+  }
+
+  if (n <= 0) {
+    printf("O arquivo %s não define DIMENSION.\n", filename);
+    return NULL;
+  }
+
+  int explicit = strcmp(type, "EXPLICIT") == 0;
+  if (strcmp(keyword, explicit ? "EDGE_WEIGHT_SECTION"
+                               : "NODE_COORD_SECTION") != 0) {
+    printf("O arquivo %s não tem a seção %s.\n", filename,
+           explicit ? "EDGE_WEIGHT_SECTION" : "NODE_COORD_SECTION");
+    return NULL;
+  }
+
+  if (explicit && strcmp(format, "FULL_MATRIX") != 0 &&
+      strcmp(format, "UPPER_ROW") != 0 && strcmp(format, "LOWER_ROW") != 0 &&
+      strcmp(format, "UPPER_DIAG_ROW") != 0 &&
+      strcmp(format, "LOWER_DIAG_ROW") != 0) {
+    printf("Formato EDGE_WEIGHT_FORMAT não suportado: %s\n", format);
+    return NULL;
+  }
+
+  if (!explicit && strcmp(type, "EUC_2D") != 0 && strcmp(type, "ATT") != 0 &&
+      strcmp(type, "GEO") != 0) {
+    printf("Tipo EDGE_WEIGHT_TYPE não suportado: %s\n", type);
+    return NULL;
+  }
+
+  cost_matrix *matrix = new_matrix(n);
+  int error = 0;
+
+  if (explicit) {
+    int symmetric = strcmp(format, "FULL_MATRIX") != 0;
+    for (int i = 0; i < n && !error; i++) {
+      for (int j = 0; j < n && !error; j++) {
+        long long w;
+        if (!is_tsplib_entry(format, i, j)) {
+          continue;
+        } else if (fscanf(file, "%lld", &w) != 1) {
+          printf("O arquivo %s tem menos pesos que o esperado.\n", filename);
+          error = 1;
+        } else if (!(error = check_file_weight(w, filename))) {
+          EDGE_COST(matrix, i, j) = (i == j) ? 0 : w;
+          if (symmetric) {
+            EDGE_COST(matrix, j, i) = EDGE_COST(matrix, i, j);
+          }
+        }
+      }
+    }
+  } else {
+    double *x = (double *)malloc(n * sizeof(double));
+    double *y = (double *)malloc(n * sizeof(double));
+    for (int i = 0; i < n && !error; i++) {
+      int node;
+      if (fscanf(file, "%d %lf %lf", &node, &x[i], &y[i]) != 3) {
+        printf("O arquivo %s tem menos coordenadas que o esperado.\n",
+               filename);
+        error = 1;
+      }
+    }
+    for (int i = 0; i < n && !error; i++) {
+      for (int j = 0; j < n && !error; j++) {
+        long long w = (i == j) ? 0 : get_tsplib_distance(type, x, y, i, j);
+        if (!(error = check_file_weight(w, filename))) {
+          EDGE_COST(matrix, i, j) = w;
+        }
+      }
+    }
+    free(x);
+    free(y);
+  }
+
+  if (error) {
+    delete_matrix(matrix);
+    return NULL;
+  }
+
+  return matrix;
+}
+
+/**
+ * Lê um peso de uma matriz binária
+ *
+ * @param data os pesos da matriz binária
+ * @param header o cabeçalho da matriz binária
+ * @param i a linha do peso
+ * @param j a coluna do peso
+ *
+ * @returns o peso
+ */
+long long get_binary_weight(unsigned char *data, binary_matrix_header *header,
+                            int i, int j) {
+  unsigned char *entry =
+      data + ((size_t)i * header->stride + j) * header->weight_size;
+  if (header->weight_size == 1) {
+    return *entry;
+  } else if (header->weight_size == 2) {
+    unsigned short w;
+    memcpy(&w, entry, sizeof(w));
+    return w;
+  } else {
+    unsigned int w;
+    memcpy(&w, entry, sizeof(w));
+    return w;
+  }
+}
+
+/**
+ * Lê uma matriz de custos de um arquivo binário, mapeando o arquivo em
+ * memória. Quando o tamanho dos pesos e a distância entre as linhas do
+ * arquivo são os mesmos da matriz, os pesos são usados direto do
+ * mapeamento, sem cópia.
+ *
+ * @param filename o nome do arquivo
+ * @param fd o descritor do arquivo, já aberto
+ *
+ * @returns a matriz de custos, ou NULL em caso de erro
+ */
+cost_matrix *read_binary_matrix(char *filename, int fd) {
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size < BINARY_MATRIX_HEADER_SIZE) {
+    printf("O arquivo %s não é uma matriz binária válida.\n", filename);
+    return NULL;
+  }
+
+  size_t mapping_size = info.st_size;
+  void *mapping = mmap(NULL, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (mapping == MAP_FAILED) {
+    printf("Não foi possível mapear o arquivo %s.\n", filename);
+    return NULL;
+  }
+
+  binary_matrix_header *header = (binary_matrix_header *)mapping;
+  unsigned char *data = (unsigned char *)mapping + BINARY_MATRIX_HEADER_SIZE;
+  int n = header->n;
+  int valid = n > 0 && header->stride >= n &&
+              (header->weight_size == 1 || header->weight_size == 2 ||
+               header->weight_size == 4) &&
+              (mapping_size - BINARY_MATRIX_HEADER_SIZE) /
+                      header->weight_size / header->stride >=
+                  (size_t)n;
+  if (!valid) {
+    printf("O arquivo %s não é uma matriz binária válida.\n", filename);
+    munmap(mapping, mapping_size);
+    return NULL;
+  }
+
+  int zero_diagonal = 1;
   for (int i = 0; i < n; i++) {
-    for (int j = 0; j < m; j++) {
-      printf("%02d ", matrix[i][j]);
+    for (int j = 0; j < n; j++) {
+      long long w = get_binary_weight(data, header, i, j);
+      if (i == j) {
+        zero_diagonal = zero_diagonal && w == 0;
+      } else if (check_file_weight(w, filename)) {
+        munmap(mapping, mapping_size);
+        return NULL;
+      }
+    }
+  }
+
+  cost_matrix *matrix;
+  if ((size_t)header->weight_size == sizeof(weight) &&
+      header->stride == get_matrix_stride(n) && zero_diagonal) {
+    matrix = (cost_matrix *)malloc(1 * sizeof(cost_matrix));
+    matrix->n = n;
+    matrix->stride = header->stride;
+    matrix->weights = (weight *)data;
+    matrix->mapping = mapping;
+    matrix->mapping_size = mapping_size;
+  } else {
+    matrix = new_matrix(n);
+    for (int i = 0; i < n; i++) {
+      weight *row = MATRIX_ROW(matrix, i);
+      for (int j = 0; j < n; j++) {
+        row[j] = (i == j) ? 0 : get_binary_weight(data, header, i, j);
+      }
+    }
+    munmap(mapping, mapping_size);
+  }
+
+  return matrix;
+}
+
+/**
+ * Lê uma matriz de custos de um arquivo, que pode ser uma matriz binária
+ * (começando com BINARY_MATRIX_MAGIC) ou um arquivo TSPLIB
+ *
+ * @param filename o nome do arquivo
+ *
+ * @returns a matriz de custos, ou NULL em caso de erro
+ */
+cost_matrix *read_cost_matrix(char *filename) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    printf("Não foi possível abrir o arquivo %s.\n", filename);
+    return NULL;
+  }
+
+  char magic[BINARY_MATRIX_MAGIC_SIZE];
+  ssize_t read_size = read(fd, magic, BINARY_MATRIX_MAGIC_SIZE);
+  cost_matrix *matrix;
+  if (read_size == BINARY_MATRIX_MAGIC_SIZE &&
+      memcmp(magic, BINARY_MATRIX_MAGIC, BINARY_MATRIX_MAGIC_SIZE) == 0) {
+    matrix = read_binary_matrix(filename, fd);
+    close(fd);
+  } else {
+    lseek(fd, 0, SEEK_SET);
+    FILE *file = fdopen(fd, "r");
+    matrix = read_tsplib_matrix(filename, file);
+    fclose(file);
+  }
+
+  return matrix;
+}
+
+/*
+************* Utilidades para arenas *************
+*/
+
+/**
+ * Obtém a classe de tamanho de uma alocação em uma arena. Alocações de
+ * até ARENA_SMALL_CLASSES * 16 bytes são agrupadas de 16 em 16 bytes, e
+ * as maiores em potências de 2.
+ *
+ * @param size o tamanho da alocação
+ * @param rounded um ponteiro para a variável que armazenará o tamanho
+ * efetivamente reservado para a alocação
+ *
+ * @returns o índice da classe de tamanho
+ */
+int get_arena_size_class(size_t size, size_t *rounded) {
+  if (size <= ARENA_SMALL_CLASSES * 16) {
+    int size_class = (size == 0) ? 0 : (int)((size - 1) / 16);
+    *rounded = (size_class + 1) * 16;
+    return size_class;
+  }
+
+  int size_class = ARENA_SMALL_CLASSES;
+  *rounded = ARENA_SMALL_CLASSES * 32;
+  while (*rounded < size) {
+    *rounded *= 2;
+    size_class++;
+  }
+
+  return size_class;
+}
+
+/**
+ * Aloca um novo bloco de memória para uma arena
+ *
+ * @param size o tamanho mínimo do bloco
+ *
+ * @returns o bloco alocado, vazio
+ */
+arena_chunk *new_arena_chunk(size_t size) {
+  size_t capacity = (size > ARENA_CHUNK_SIZE) ? size : ARENA_CHUNK_SIZE;
+  arena_chunk *chunk =
+      (arena_chunk *)malloc(sizeof(arena_chunk) + capacity * sizeof(char));
+  chunk->next = NULL;
+  chunk->used = 0;
+  chunk->capacity = capacity;
+  return chunk;
+}
+
+/**
+ * Cria uma nova arena vazia
+ *
+ * @returns uma arena alocada dinamicamente
+ */
+arena *new_arena() {
+  arena *a = (arena *)malloc(1 * sizeof(arena));
+  a->chunks = new_arena_chunk(ARENA_CHUNK_SIZE);
+  a->current = a->chunks;
+  for (int i = 0; i < ARENA_SIZE_CLASSES; i++) {
+    a->free_lists[i] = NULL;
+  }
+  return a;
+}
+
+/**
+ * Libera uma arena e, de uma só vez, tudo o que foi alocado nela
+ *
+ * @param a a arena a ser liberada
+ *
+ * @returns void
+ */
+void delete_arena(arena *a) {
+  arena_chunk *chunk = a->chunks;
+  while (chunk != NULL) {
+    arena_chunk *next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+  free(a);
+  a = NULL;
+}
+
+/**
+ * Aloca memória em uma arena. Espaços liberados com arena_free são
+ * reutilizados antes de se avançar no bloco atual.
+ *
+ * @param a a arena
+ * @param size o tamanho da alocação
+ *
+ * @returns um ponteiro para a memória alocada
+ */
+void *arena_alloc(arena *a, size_t size) {
+  size_t rounded;
+  int size_class = get_arena_size_class(size, &rounded);
+
+  void *ptr = a->free_lists[size_class];
+  if (ptr != NULL) {
+    a->free_lists[size_class] = *(void **)ptr;
+    return ptr;
+  }
+
+  while (a->current->used + rounded > a->current->capacity) {
+    if (a->current->next == NULL) {
+      a->current->next = new_arena_chunk(rounded);
     }
-    printf("\n");
+    a->current = a->current->next;
   }
-  printf("\n");
+
+  ptr = a->current->data + a->current->used;
+  a->current->used += rounded;
+  return ptr;
+}
+
+/**
+ * Devolve à arena um espaço alocado com arena_alloc, para que seja
+ * reutilizado por outra alocação do mesmo tamanho
+ *
+ * @param a a arena onde o espaço foi alocado
+ * @param ptr o espaço a ser liberado
+ * @param size o tamanho passado a arena_alloc
+ *
+ * @returns void
+ */
+void arena_free(arena *a, void *ptr, size_t size) {
+  size_t rounded;
+  int size_class = get_arena_size_class(size, &rounded);
+  *(void **)ptr = a->free_lists[size_class];
+  a->free_lists[size_class] = ptr;
 }
 
 /*
 ************* Utilidades para paths *************
 */
 
+/**
+ * Obtém o tamanho, em bytes, de um path com espaço para max_path_size nós
+ *
+ * @returns o tamanho de um path
+ */
+size_t get_path_bytes() { return sizeof(path) + max_path_size * sizeof(int); }
+
 /**
  * Cria um novo path vazio
  *
- * @returns um path alocado dinamicamente
+ * @returns um path alocado na arena da thread
  */
 path *new_path() {
-  path *p = (path *)malloc(1 * sizeof(path));
-  for (int i = 0; i < MAX_PATH_SIZE; i++) {
+  path *p = (path *)arena_alloc(path_arena, get_path_bytes());
+  for (int i = 0; i < max_path_size; i++) {
     p->nodes[i] = -1;
   }
   p->cost = COST_NOT_COMPUTED;
@@ -129,12 +863,13 @@ path *new_path() {
 }
 
 /**
- * Libera a memória alocada para p
+ * Libera a memória alocada para p. O path deve ter sido alocado na arena
+ * da thread atual.
  *
  * @param p o path a ser desalocado
  */
 void delete_path(path *p) {
-  free(p);
+  arena_free(path_arena, p, get_path_bytes());
   p = NULL;
 }
 
@@ -148,7 +883,7 @@ void delete_path(path *p) {
  */
 path *copy_path(path *original) {
   path *p = new_path();
-  memcpy(p->nodes, original->nodes, MAX_PATH_SIZE * sizeof(int));
+  memcpy(p->nodes, original->nodes, max_path_size * sizeof(int));
   p->size = original->size;
   p->cost = original->cost;
   return p;
@@ -177,10 +912,11 @@ void concatenate_to_path(path *p, int n) { p->nodes[p->size++] = n; }
  *
  * @returns o custo do caminho p, de acordo com adj
  */
-int get_path_cost(path *p, int **adj) {
+int get_path_cost(path *p, cost_matrix *adj) {
   if (p->cost == COST_NOT_COMPUTED) {
+    p->cost = 0;
     for (int i = 0; i < (p->size - 1); i++) {
-      int current_cost = adj[p->nodes[i]][p->nodes[i + 1]];
+      int current_cost = EDGE_COST(adj, p->nodes[i], p->nodes[i + 1]);
       if (current_cost == MAX_COST) {
         p->cost = COST_INFINITE;
         break;
@@ -196,15 +932,16 @@ int get_path_cost(path *p, int **adj) {
 /**
  * Imprime um caminho
  *
+ * @param stream o arquivo onde o caminho é impresso
  * @param p o caminho
  *
  * @returns void
  */
-void print_path(path *p) {
+void print_path(FILE *stream, path *p) {
   for (int i = 0; i < p->size - 1; i++) {
-    printf("%d -> ", p->nodes[i]);
+    fprintf(stream, "%d -> ", p->nodes[i]);
   }
-  printf("%d\n", p->nodes[p->size - 1]);
+  fprintf(stream, "%d\n", p->nodes[p->size - 1]);
 }
 
 /*
@@ -212,18 +949,38 @@ void print_path(path *p) {
 */
 
 /**
- * Aloca uma nova path list dinamicamente
+ * Aloca uma nova path list na arena da thread
  *
- * @returns uma path list nova e vazia, alocada dinamicamente
+ * @returns uma path list nova e vazia, alocada na arena da thread
  */
 path_list *new_path_list() {
-  path_list *pl = (path_list *)malloc(1 * sizeof(path_list));
-  pl->paths = (path **)malloc(PATH_LIST_SIZE * sizeof(path *));
+  path_list *pl = (path_list *)arena_alloc(path_arena, sizeof(path_list));
+  pl->paths = pl->_initial_paths;
   pl->size = 0;
   pl->_actual_size = PATH_LIST_SIZE;
+  pl->cost = PATH_LIST_EMPTY;
+  pl->count = 0;
+  pl->limit = PATH_LIST_UNLIMITED;
+  pl->stream = NULL;
   return pl;
 }
 
+/**
+ * Define quais caminhos uma path list guarda, de acordo com o modo de saída.
+ * Em todos os modos, os caminhos de menor custo são contados.
+ *
+ * @param pl a path list, ainda vazia
+ * @param output o modo de saída (OUTPUT_*)
+ * @param stream o arquivo onde os caminhos são escritos no modo OUTPUT_STREAM
+ *
+ * @returns void
+ */
+void set_path_list_output(path_list *pl, int output, FILE *stream) {
+  pl->limit = (output == OUTPUT_ALL) ? PATH_LIST_UNLIMITED
+                                     : (output == OUTPUT_FIRST) ? 1 : 0;
+  pl->stream = (output == OUTPUT_STREAM) ? stream : NULL;
+}
+
 /**
  * Libera o espaço de uma path list, sem liberar
  * os paths dentro dela
@@ -233,8 +990,10 @@ path_list *new_path_list() {
  * @returns void
  */
 void delete_path_list(path_list *pl) {
-  free(pl->paths);
-  free(pl);
+  if (pl->paths != pl->_initial_paths) {
+    arena_free(path_arena, pl->paths, pl->_actual_size * sizeof(path *));
+  }
+  arena_free(path_arena, pl, sizeof(path_list));
   pl = NULL;
 }
 
@@ -262,7 +1021,8 @@ void delete_path_list_paths(path_list *pl) {
  */
 
 path_list **new_path_list_list(int n) {
-  path_list **pll = (path_list **)malloc(n * sizeof(path_list *));
+  path_list **pll =
+      (path_list **)arena_alloc(path_arena, n * sizeof(path_list *));
   return pll;
 }
 
@@ -280,7 +1040,7 @@ void delete_path_list_list(path_list **pll, int n) {
     delete_path_list_paths(pll[i]);
     delete_path_list(pll[i]);
   }
-  free(pll);
+  arena_free(path_arena, pll, n * sizeof(path_list *));
   pll = NULL;
 }
 
@@ -296,7 +1056,12 @@ void delete_path_list_list(path_list **pll, int n) {
 void concatenate_to_path_list(path_list *pl, path *p) {
   if (pl->size == pl->_actual_size) { // Aloca espaço adicional se necessário
     int new_size = 2 * pl->_actual_size;
-    pl->paths = realloc(pl->paths, new_size * sizeof(path *));
+    path **paths = (path **)arena_alloc(path_arena, new_size * sizeof(path *));
+    memcpy(paths, pl->paths, pl->size * sizeof(path *));
+    if (pl->paths != pl->_initial_paths) {
+      arena_free(path_arena, pl->paths, pl->_actual_size * sizeof(path *));
+    }
+    pl->paths = paths;
     pl->_actual_size = new_size;
   }
 
@@ -310,191 +1075,1824 @@ void concatenate_to_path_list(path_list *pl, path *p) {
  * armazenar paths com o mesmo exato custo.
  *
  * @param pl a path list
- * @param adj a matriz de adjacências do grafo
  *
- * @returns o custo do primeiro caminhoa na path list ou PATH_LIST_EMPTY, se a
- * path list estiver vazia
+ * @returns o custo dos caminhos na path list ou PATH_LIST_EMPTY, se nenhum
+ * caminho foi registrado nela
  */
-int get_path_list_paths_cost(path_list *pl, int **adj) {
-  if (pl->size == 0) {
+int get_path_list_paths_cost(path_list *pl) {
+  if (pl->count == 0) {
     return PATH_LIST_EMPTY;
   }
 
-  return get_path_cost(pl->paths[0], adj);
+  return pl->cost;
 }
 
 /**
- * Junta duas path lists em uma, copindo os elementos da segunda e os
- * concatenando à primeira
+ * Descarta os caminhos registrados em uma path list, inclusive os escritos
+ * no seu arquivo
  *
- * @param dest uma das path lists, onde o resultado ficará armazenado
- * @param other a outra path list, que terá seus paths copiados e concatenados a
- * dest
+ * @param pl a path list
  *
  * @returns void
  */
-void merge_path_lists(path_list *dest, path_list *other) {
-  for (int i = 0; i < other->size; i++) {
-    path *copy = copy_path(other->paths[i]);
-    concatenate_to_path_list(dest, copy);
+void reset_path_list(path_list *pl) {
+  delete_path_list_paths(pl);
+  pl->count = 0;
+
+  if (pl->stream != NULL) {
+    fflush(pl->stream);
+    if (ftruncate(fileno(pl->stream), 0) != 0) {
+      printf("Não foi possível sobrescrever o arquivo de saída.\n");
+      exit(1);
+    }
+    rewind(pl->stream);
   }
 }
 
-/*
-********* Funções do problema principal *********
-*/
-
 /**
- * Gera uma matriz de custos para o grafo
+ * Guarda uma cópia de p na path list, ou o escreve no arquivo da path list,
+ * sem contá-lo. Se a path list já guarda o máximo de caminhos, p é ignorado.
  *
- * @param n o número de vértices do grafo
+ * @param pl a path list
+ * @param p o path a ser guardado
  *
- * @returns a matriz de custos das arestas
+ * @returns void
  */
-int **get_cost_matrix(int n) {
-  int **matrix = new_square_matrix(n);
-  for (int i = 0; i < n; i++) {
-    for (int j = 0; j < n; j++) {
-      matrix[i][j] = rand() % (MAX_COST + 1);
-    }
-    matrix[i][i] = 0;
+void store_path(path_list *pl, path *p) {
+  if (pl->stream != NULL) {
+    print_path(pl->stream, p);
+  } else if (pl->limit == PATH_LIST_UNLIMITED || pl->size < pl->limit) {
+    concatenate_to_path_list(pl, copy_path(p));
   }
-
-  return matrix;
 }
 
 /**
- * Resolve o problema para um dado n, uma lista de adjacências e o caminho
- * inicial. Esse algoritmo é uma busca em profundidade.
+ * Registra um caminho de custo cost em uma path list. Se ele for mais barato
+ * que os caminhos registrados até então, eles são descartados; se for mais
+ * caro, é ignorado. Assim, a path list mantém apenas os caminhos de menor
+ * custo, dos quais guarda no máximo pl->limit.
  *
- * @param n o número de nós no grafo
- * @param adj a lista de adjacências do grafo, com os pesos
- * @param initial_path o caminho inicial. Esse caminho será deletado pela função
- * após utilizado.
+ * @param pl a path list
+ * @param p o caminho, que é copiado se precisar ser guardado
+ * @param cost o custo do caminho
  *
- * @returns uma lista de caminhos com o menor custo
+ * @returns void
  */
-path_list *solve_problem(int n, int **adj, path *initial_path) {
-  // printf("Solve problem chamado para o caminho: ");
-  // print_path(initial_path);
+void add_to_path_list(path_list *pl, path *p, int cost) {
+  if (pl->count > 0 && cost > pl->cost) {
+    return;
+  }
 
-  if (initial_path->size == n) { // Caso base da recursão
-    concatenate_to_path(initial_path, STARTING_NODE);
-    path *res = copy_path(initial_path);
-    path_list *pl = new_path_list();
-    concatenate_to_path_list(pl, res);
-    return pl;
-  } else {
-    // Lista de caminhos visitados
-    int visited[MAX_GRAPH_SIZE];
-    for (int i = 0; i < MAX_GRAPH_SIZE; i++) {
-      visited[i] = 0;
-    }
+  if (pl->count > 0 && cost < pl->cost) {
+    reset_path_list(pl);
+  }
 
-    for (int i = 0; i < initial_path->size; i++) {
-      visited[initial_path->nodes[i]] = 1;
-    }
+  pl->cost = cost;
+  pl->count++;
+  p->cost = cost;
+  store_path(pl, p);
+}
 
-    path_list **pll =
-        new_path_list_list(n);  // Lista de todos os path lists gerados
-    int min_cost = __INT_MAX__; // Custo mínimo dos caminhos
+/**
+ * Copia todo o conteúdo de um arquivo para o fim de outro
+ *
+ * @param dest o arquivo de destino
+ * @param src o arquivo copiado, lido desde o início
+ *
+ * @returns void
+ */
+void copy_stream(FILE *dest, FILE *src) {
+  char buffer[STREAM_CHUNK_SIZE];
+  size_t read;
 
-    for (int i = 0; i < n; i++) {
+  fflush(src);
+  rewind(src);
+  while ((read = fread(buffer, 1, STREAM_CHUNK_SIZE, src)) > 0) {
+    fwrite(buffer, 1, read, dest);
+  }
+}
+
+/**
+ * Junta duas path lists em uma, mantendo apenas os caminhos de menor custo.
+ * Os caminhos de other são copiados para dest, até o limite de dest, e o
+ * arquivo de other é copiado para o de dest.
+ *
+ * @param dest uma das path lists, onde o resultado ficará armazenado
+ * @param other a outra path list, que não é modificada
+ *
+ * @returns void
+ */
+void merge_path_lists(path_list *dest, path_list *other) {
+  if (other->count == 0 || (dest->count > 0 && other->cost > dest->cost)) {
+    return;
+  }
+
+  if (dest->count > 0 && other->cost < dest->cost) {
+    reset_path_list(dest);
+  }
+
+  dest->cost = other->cost;
+  dest->count += other->count;
+  for (int i = 0; i < other->size; i++) {
+    store_path(dest, other->paths[i]);
+  }
+
+  if (dest->stream != NULL && other->stream != NULL) {
+    copy_stream(dest->stream, other->stream);
+  }
+}
+
+/*
+****** Utilidades para medição de desempenho ******
+*/
+
+/**
+ * Obtém o tempo atual de um relógio monotônico, para medir intervalos
+ *
+ * @returns o tempo atual, em segundos
+ */
+double get_time() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/**
+ * Imprime na saída de erro, em uma linha JSON, o tempo gasto em cada fase da
+ * execução e o total, para que os tempos possam ser lidos por scripts
+ *
+ * @param n o número de nós no grafo
+ * @param seed a semente da matriz aleatória
+ * @param ranks o número de processos
+ * @param threads o número de threads por processo
+ *
+ * @returns void
+ */
+void print_phase_times(int n, int seed, int ranks, int threads) {
+  double total = 0;
+  fflush(stdout);
+
+  fprintf(stderr,
+          "{\"n\": %d, \"seed\": %d, \"ranks\": %d, \"threads\": %d", n,
+          seed, ranks, threads);
+  for (int i = 0; i < PHASES; i++) {
+    fprintf(stderr, ", \"%s\": %.6f", phase_names[i], phase_times[i]);
+    total += phase_times[i];
+  }
+  fprintf(stderr, ", \"total\": %.6f}\n", total);
+}
+
+/**
+ * Imprime na saída de erro uma linha da tabela de contadores da busca
+ *
+ * @param rank o rótulo da coluna do processo
+ * @param thread o rótulo da coluna da thread
+ * @param counters os contadores
+ *
+ * @returns void
+ */
+void print_counters_row(const char *rank, const char *thread,
+                        long long *counters) {
+  fprintf(stderr, "%6s %7s", rank, thread);
+  for (int i = 0; i < COUNTERS; i++) {
+    fprintf(stderr, " %12lld", counters[i]);
+  }
+  fprintf(stderr, "\n");
+}
+
+/**
+ * Imprime na saída de erro quantos ramos a busca considerou e a fração deles
+ * que foi podada ou descartada por arestas inexistentes
+ *
+ * @param counters os contadores de toda a busca
+ *
+ * @returns void
+ */
+void print_branch_summary(long long *counters) {
+  long long branches = counters[COUNTER_EXPANDED] +
+                       counters[COUNTER_INFEASIBLE] + counters[COUNTER_PRUNED];
+  double total = (branches > 0) ? branches : 1;
+  fprintf(stderr,
+          "Ramos considerados: %lld, dos quais %.2f%% podados e %.2f%% "
+          "inviáveis\n",
+          branches, 100.0 * counters[COUNTER_PRUNED] / total,
+          100.0 * counters[COUNTER_INFEASIBLE] / total);
+}
+
+/**
+ * Imprime na saída de erro os contadores da busca
+ *
+ * @returns void
+ */
+void print_search_counters() {
+  fflush(stdout);
+  fprintf(stderr, "Contadores da busca:\n" COUNTERS_HEADER "\n");
+  print_counters_row("0", "0", search_counters);
+  print_branch_summary(search_counters);
+}
+
+/*
+***** Utilidades para o limitante inferior *****
+*/
+
+/**
+ * Cria os limitantes inferiores de um grafo. Como o grafo é direcionado, a
+ * 1-tree usa o menor custo entre os dois sentidos de cada aresta.
+ *
+ * @param adj a matriz de adjacências do grafo
+ *
+ * @returns os limitantes, sem nenhuma designação resolvida e com todas as
+ * penalidades nulas
+ */
+lower_bound *new_lower_bound(cost_matrix *adj) {
+  int n = adj->n;
+  lower_bound *b = (lower_bound *)malloc(sizeof(lower_bound));
+  b->n = n;
+  b->assignments = (assignment *)malloc((n + 1) * sizeof(assignment));
+  int *data = (int *)malloc((n + 1) * (4 * n + 2) * sizeof(int));
+  for (int size = 0; size <= n; size++) {
+    assignment *a = &b->assignments[size];
+    a->successors = data + (size * (4 * n + 2));
+    a->predecessors = a->successors + n;
+    a->row_potentials = a->predecessors + (n + 1);
+    a->column_potentials = a->row_potentials + n;
+    a->solved = 0;
+  }
+  b->columns = (int *)malloc((n + 1) * sizeof(int));
+  b->slacks = (int *)malloc((n + 1) * sizeof(int));
+  b->ways = (int *)malloc((n + 1) * sizeof(int));
+  b->used = (int *)malloc((n + 1) * sizeof(int));
+  b->costs = (int *)malloc(n * n * sizeof(int));
+  b->penalties = (double *)calloc(n, sizeof(double));
+  b->nodes = (int *)malloc(n * sizeof(int));
+  b->parents = (int *)malloc(n * sizeof(int));
+  b->degrees = (int *)malloc(n * sizeof(int));
+  b->distances = (double *)malloc(n * sizeof(double));
+
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < n; j++) {
+      int forward = EDGE_COST(adj, i, j), backward = EDGE_COST(adj, j, i);
+      int cost = (forward < backward) ? forward : backward;
+      b->costs[i * n + j] = (cost == MAX_COST) ? COST_INFINITE : cost;
+    }
+  }
+
+  return b;
+}
+
+/**
+ * Libera o limitante criado por new_lower_bound
+ *
+ * @param b o limitante
+ *
+ * @returns void
+ */
+void delete_lower_bound(lower_bound *b) {
+  free(b->assignments[0].successors);
+  free(b->assignments);
+  free(b->columns);
+  free(b->slacks);
+  free(b->ways);
+  free(b->used);
+  free(b->costs);
+  free(b->penalties);
+  free(b->nodes);
+  free(b->parents);
+  free(b->degrees);
+  free(b->distances);
+  free(b);
+}
+
+/**
+ * Designa um sucessor a row pelo caminho aumentante mais barato, como no
+ * algoritmo húngaro. Os custos reduzidos das arestas (custo menos as
+ * variáveis duais das suas pontas) são mantidos não negativos, e os das
+ * arestas designadas, nulos, o que garante que a designação continue ótima.
+ *
+ * @param s o estado da busca
+ * @param a a designação, com row sem sucessor
+ * @param row a linha a designar
+ * @param m o número de colunas em s->bound->columns
+ *
+ * @returns 1 se row foi designada, 0 se não há caminho aumentante
+ */
+int augment_assignment(search *s, assignment *a, int row, int m) {
+  lower_bound *b = s->bound;
+  int n = b->n;
+  int last = s->current->nodes[s->current->size - 1];
+
+  for (int j = 0; j < m; j++) {
+    b->slacks[b->columns[j]] = COST_INFINITE;
+    b->used[b->columns[j]] = 0;
+  }
+
+  // O caminho começa pela coluna virtual n, designada a row
+  int column = n;
+  a->predecessors[n] = row;
+  do {
+    b->used[column] = 1;
+    int from = a->predecessors[column];
+    weight *w = MATRIX_ROW(s->adj, from);
+    int delta = COST_INFINITE, next = -1;
+
+    for (int j = 0; j < m; j++) {
+      int c = b->columns[j];
+      if (b->used[c]) {
+        continue;
+      }
+      /* O último nó não pode voltar direto a STARTING_NODE, já que ainda
+      há nós não visitados */
+      if (c != from && w[c] != MAX_COST &&
+          !(from == last && c == STARTING_NODE)) {
+        int reduced = w[c] - a->row_potentials[from] - a->column_potentials[c];
+        if (reduced < b->slacks[c]) {
+          b->slacks[c] = reduced;
+          b->ways[c] = column;
+        }
+      }
+      if (b->slacks[c] < delta) {
+        delta = b->slacks[c];
+        next = c;
+      }
+    }
+
+    if (next == -1) {
+      return 0;
+    }
+
+    a->row_potentials[row] += delta;
+    for (int j = 0; j < m; j++) {
+      int c = b->columns[j];
+      if (b->used[c]) {
+        a->row_potentials[a->predecessors[c]] += delta;
+        a->column_potentials[c] -= delta;
+      } else if (b->slacks[c] != COST_INFINITE) {
+        b->slacks[c] -= delta;
+      }
+    }
+    column = next;
+  } while (a->predecessors[column] != -1);
+
+  // Inverte as designações ao longo do caminho
+  do {
+    int previous = b->ways[column];
+    a->predecessors[column] = a->predecessors[previous];
+    a->successors[a->predecessors[column]] = column;
+    column = previous;
+  } while (column != n);
+
+  return 1;
+}
+
+/**
+ * Calcula o limitante do problema de designação para o restante dos ciclos
+ * que completam s->current. Cada nó não visitado e o último nó do caminho
+ * precisam de um sucessor distinto entre os nós não visitados e
+ * STARTING_NODE, e a designação de menor custo limita o restante do ciclo.
+ * Ao contrário da 1-tree, esse limitante respeita o sentido das arestas.
+ *
+ * A designação é mantida para cada tamanho do caminho. Se a do caminho sem o
+ * último nó está resolvida, ela é reaproveitada: a linha do penúltimo nó e a
+ * coluna do último deixam o problema, e só os nós que perderam o sucessor
+ * são designados de novo, em O(n²) cada, ao invés de resolver tudo em O(n³).
+ *
+ * @param s o estado da busca
+ *
+ * @returns o custo da designação, ou COST_INFINITE se não há nenhuma
+ */
+int get_assignment_bound(search *s) {
+  lower_bound *b = s->bound;
+  int n = b->n;
+  path *p = s->current;
+  int last = p->nodes[p->size - 1];
+  assignment *a = &b->assignments[p->size];
+
+  if (p->size >= 2 && b->assignments[p->size - 1].solved) {
+    memcpy(a->successors, b->assignments[p->size - 1].successors,
+           (4 * n + 2) * sizeof(int));
+    int previous = p->nodes[p->size - 2];
+    if (a->successors[previous] != -1) {
+      a->predecessors[a->successors[previous]] = -1;
+    }
+    if (a->predecessors[last] != -1) {
+      a->successors[a->predecessors[last]] = -1;
+    }
+    a->predecessors[last] = -1;
+
+    // A aresta de volta a STARTING_NODE deixa de ser permitida
+    if (a->successors[last] == STARTING_NODE) {
+      a->successors[last] = -1;
+      a->predecessors[STARTING_NODE] = -1;
+    }
+  } else {
+    memset(a->successors, -1, (2 * n + 1) * sizeof(int));
+    memset(a->row_potentials, 0, (2 * n + 1) * sizeof(int));
+  }
+
+  int m = 0;
+  b->columns[m++] = STARTING_NODE;
+  for (int w = 0; w < SET_WORDS(n); w++) {
+    for (unsigned long long set = s->unvisited[w]; set != 0; set &= set - 1) {
+      b->columns[m++] = (w * SET_WORD_BITS) + __builtin_ctzll(set);
+    }
+  }
+
+  // As linhas são o último nó e os não visitados, nas colunas 1 a m - 1
+  a->solved = 0;
+  int total = 0;
+  for (int j = 0; j < m; j++) {
+    int row = (j == 0) ? last : b->columns[j];
+    if (a->successors[row] == -1 && !augment_assignment(s, a, row, m)) {
+      return COST_INFINITE;
+    }
+  }
+  for (int j = 0; j < m; j++) {
+    int row = (j == 0) ? last : b->columns[j];
+    total += EDGE_COST(s->adj, row, a->successors[row]);
+  }
+  a->solved = 1;
+
+  return total;
+}
+
+/**
+ * Calcula um limitante inferior para o custo dos ciclos que completam
+ * s->current. O restante de um ciclo é um caminho que sai do último nó de
+ * s->current, passa por todos os nós não visitados e volta a STARTING_NODE.
+ * Esse caminho contém uma árvore geradora dos nós não visitados, mais uma
+ * aresta que sai do último nó e uma que chega em STARTING_NODE, então o custo
+ * dessa 1-tree mínima o limita.
+ *
+ * A 1-tree é calculada com o custo de cada aresta somado às penalidades dos
+ * seus nós, que são ajustadas por subgradiente para que os nós tenham grau 2,
+ * como em um caminho. Qualquer penalidade resulta em um limitante válido, então
+ * elas são mantidas de um cálculo para o outro.
+ *
+ * @param s o estado da busca
+ * @param cost o custo de s->current
+ * @param best_cost o melhor custo conhecido. O cálculo para assim que o
+ * limitante o ultrapassa.
+ *
+ * @returns o limitante, ou INFINITY se nenhum ciclo completa s->current
+ */
+double get_one_tree_bound(search *s, int cost, int best_cost) {
+  lower_bound *b = s->bound;
+  int n = b->n;
+  int last = s->current->nodes[s->current->size - 1];
+  double bound = 0;
+
+  int k = 0;
+  for (int w = 0; w < SET_WORDS(n); w++) {
+    for (unsigned long long set = s->unvisited[w]; set != 0; set &= set - 1) {
+      b->nodes[k++] = (w * SET_WORD_BITS) + __builtin_ctzll(set);
+    }
+  }
+
+  for (int iteration = 0; iteration < BOUND_ITERATIONS; iteration++) {
+    double value = cost;
+    for (int j = 0; j < k; j++) {
+      value -= 2 * b->penalties[b->nodes[j]];
+      b->degrees[j] = 0;
+      b->parents[j] = 0;
+      b->distances[j] = INFINITY;
+    }
+
+    // Árvore geradora mínima dos nós não visitados, pelo algoritmo de Prim
+    for (int added = 0, next = 0; added < k; added++) {
+      int u = b->nodes[next];
+      if (added > 0) {
+        value += b->distances[next];
+        b->degrees[next]++;
+        b->degrees[b->parents[next]]++;
+      }
+      b->parents[next] = -1; // Marca o nó como parte da árvore
+
+      int closest = -1;
+      for (int j = 0; j < k; j++) {
+        if (b->parents[j] == -1) {
+          continue;
+        }
+        int edge = b->costs[u * n + b->nodes[j]];
+        double distance = edge + b->penalties[u] + b->penalties[b->nodes[j]];
+        if (edge != COST_INFINITE && distance < b->distances[j]) {
+          b->distances[j] = distance;
+          b->parents[j] = next;
+        }
+        if (closest == -1 || b->distances[j] < b->distances[closest]) {
+          closest = j;
+        }
+      }
+
+      if (added < k - 1 && b->distances[closest] == INFINITY) {
+        return INFINITY; // Os nós não visitados não são conexos
+      }
+      next = closest;
+    }
+
+    // As arestas que ligam a árvore ao último nó e a STARTING_NODE
+    int out = -1, in = -1;
+    weight *row = MATRIX_ROW(s->adj, last);
+    for (int j = 0; j < k; j++) {
+      int u = b->nodes[j];
+      int edge = EDGE_COST(s->adj, u, STARTING_NODE);
+      if (row[u] != MAX_COST &&
+          (out == -1 || row[u] + b->penalties[u] <
+                            row[b->nodes[out]] + b->penalties[b->nodes[out]])) {
+        out = j;
+      }
+      if (edge != MAX_COST &&
+          (in == -1 || edge + b->penalties[u] <
+                           EDGE_COST(s->adj, b->nodes[in], STARTING_NODE) +
+                               b->penalties[b->nodes[in]])) {
+        in = j;
+      }
+    }
+
+    if (out == -1 || in == -1) {
+      return INFINITY;
+    }
+    value += row[b->nodes[out]] + b->penalties[b->nodes[out]];
+    value += EDGE_COST(s->adj, b->nodes[in], STARTING_NODE) +
+             b->penalties[b->nodes[in]];
+    b->degrees[out]++;
+    b->degrees[in]++;
+
+    if (value > bound) {
+      bound = value;
+    }
+    if (bound > best_cost + BOUND_EPSILON) {
+      break;
+    }
+
+    // Passo do subgradiente, proporcional à distância até o melhor custo
+    int norm = 0;
+    for (int j = 0; j < k; j++) {
+      norm += (b->degrees[j] - 2) * (b->degrees[j] - 2);
+    }
+    if (norm == 0) {
+      break; // A 1-tree já é um caminho, e o limitante não melhora
+    }
+    double step = BOUND_STEP * (best_cost - value) / norm;
+    for (int j = 0; j < k; j++) {
+      b->penalties[b->nodes[j]] += step * (b->degrees[j] - 2);
+    }
+  }
+
+  return bound;
+}
+
+/**
+ * Verifica se os ciclos que completam s->current podem ser podados, ou seja,
+ * se um limitante inferior do seu custo é maior que o melhor custo conhecido.
+ * A comparação é estrita para manter todos os empates. O limitante da
+ * designação, mais barato, é calculado primeiro, e o 1-tree só se ele não
+ * bastar para a poda. Os limitantes só são calculados se restarem ao menos
+ * BOUND_MIN_REMAINING nós, já que abaixo disso a busca é mais barata que eles.
+ *
+ * @param s o estado da busca, com s->bound não nulo
+ * @param cost o custo de s->current
+ *
+ * @returns 1 se os ciclos podem ser podados, 0 caso contrário
+ */
+int exceeds_lower_bound(search *s, int cost) {
+  int best_cost = *s->best_cost;
+  if (best_cost == COST_INFINITE ||
+      s->n - s->current->size < BOUND_MIN_REMAINING) {
+    // Os filhos não podem reaproveitar essa designação
+    s->bound->assignments[s->current->size].solved = 0;
+    return 0;
+  }
+
+  int assignment_cost = get_assignment_bound(s);
+  if (assignment_cost == COST_INFINITE ||
+      cost + assignment_cost > best_cost) {
+    return 1;
+  }
+
+  return get_one_tree_bound(s, cost, best_cost) > best_cost + BOUND_EPSILON;
+}
+
+/*
+****** Utilidades para a solução inicial ******
+*/
+
+/**
+ * Constrói um ciclo pelo vizinho mais próximo: a partir de first, o ciclo
+ * segue sempre para o nó não visitado mais barato e, no fim, volta a first
+ *
+ * @param adj a matriz de adjacências do grafo
+ * @param first o nó inicial
+ * @param tour onde o ciclo é escrito, com n + 1 nós, começando e terminando
+ * em first
+ *
+ * @returns o custo do ciclo, ou COST_INFINITE se a construção chegou a um nó
+ * sem arestas para os nós restantes
+ */
+int build_nearest_neighbor_tour(cost_matrix *adj, int first, int *tour) {
+  int n = adj->n;
+  int cost = 0;
+  char *visited = (char *)calloc(n, sizeof(char));
+
+  tour[0] = first;
+  visited[first] = 1;
+  for (int size = 1; size < n; size++) {
+    weight *row = MATRIX_ROW(adj, tour[size - 1]);
+    int next = -1;
+    for (int i = 0; i < n; i++) {
+      if (!visited[i] && row[i] != MAX_COST &&
+          (next == -1 || row[i] < row[next])) {
+        next = i;
+      }
+    }
+
+    if (next == -1) {
+      free(visited);
+      return COST_INFINITE;
+    }
+    visited[next] = 1;
+    tour[size] = next;
+    cost += row[next];
+  }
+  free(visited);
+
+  tour[n] = first;
+  int edge = EDGE_COST(adj, tour[n - 1], first);
+  return (edge == MAX_COST) ? COST_INFINITE : cost + edge;
+}
+
+/**
+ * Melhora um ciclo com 2-opt: o trecho tour[i..j] é invertido sempre que isso
+ * reduz o custo do ciclo, até que nenhuma inversão o reduza. Como o grafo é
+ * direcionado, as arestas do trecho invertido são somadas no sentido
+ * contrário. O primeiro e o último nó do ciclo não saem do lugar.
+ *
+ * @param adj a matriz de adjacências do grafo
+ * @param tour o ciclo, com n + 1 nós, modificado no lugar
+ * @param cost o custo do ciclo
+ *
+ * @returns o custo do ciclo melhorado
+ */
+int improve_tour(cost_matrix *adj, int *tour, int cost) {
+  int n = adj->n;
+
+  for (int improved = 1; improved;) {
+    improved = 0;
+    for (int i = 1; i < n - 1; i++) {
+      int forward = 0, backward = 0; // O custo de tour[i..j] nos dois sentidos
+      for (int j = i + 1; j < n; j++) {
+        int reverse = EDGE_COST(adj, tour[j], tour[j - 1]);
+        if (reverse == MAX_COST) {
+          break; // Nenhum trecho que contenha essa aresta pode ser invertido
+        }
+        forward += EDGE_COST(adj, tour[j - 1], tour[j]);
+        backward += reverse;
+
+        int in = EDGE_COST(adj, tour[i - 1], tour[j]);
+        int out = EDGE_COST(adj, tour[i], tour[j + 1]);
+        if (in == MAX_COST || out == MAX_COST) {
+          continue;
+        }
+
+        int delta = (in + backward + out) -
+                    (EDGE_COST(adj, tour[i - 1], tour[i]) + forward +
+                     EDGE_COST(adj, tour[j], tour[j + 1]));
+        if (delta < 0) {
+          for (int a = i, b = j; a < b; a++, b--) {
+            int node = tour[a];
+            tour[a] = tour[b];
+            tour[b] = node;
+          }
+          cost += delta;
+          improved = 1;
+          break; // Os custos dos trechos a partir de i mudaram
+        }
+      }
+    }
+  }
+
+  return cost;
+}
+
+/**
+ * Calcula o custo de uma solução inicial para o branch and bound: o menor
+ * entre os ciclos construídos pelo vizinho mais próximo a partir dos nós
+ * first, first + step, first + 2 * step, ..., melhorados com 2-opt. A busca
+ * começa a podar com esse custo, ao invés de esperar pelo primeiro caminho
+ * completo. O ciclo em si não é guardado, já que a busca o encontra de novo
+ * se ele for ótimo.
+ *
+ * @param adj a matriz de adjacências do grafo
+ * @param first o primeiro nó inicial
+ * @param step a distância entre dois nós iniciais
+ *
+ * @returns o custo, ou COST_INFINITE se nenhum ciclo foi encontrado
+ */
+int get_warm_start_cost(cost_matrix *adj, int first, int step) {
+  int n = adj->n;
+  int best_cost = COST_INFINITE;
+  int *tour = (int *)malloc((n + 1) * sizeof(int));
+
+  for (int start = first; start < n; start += step) {
+    int cost = build_nearest_neighbor_tour(adj, start, tour);
+    if (cost != COST_INFINITE) {
+      cost = improve_tour(adj, tour, cost);
+      if (cost < best_cost) {
+        best_cost = cost;
+      }
+    }
+  }
+
+  free(tour);
+  return best_cost;
+}
+
+/*
+****** Utilidades para as folhas da busca ******
+*/
+
+/**
+ * Preenche as tabelas leaf_permutations e leaf_edges. Na matriz edges de
+ * search_leaves, os índices 0 a LEAF_LEVELS - 1 são os nós restantes, e o
+ * índice LEAF_LEVELS é o último nó do caminho, nas linhas, e STARTING_NODE,
+ * nas colunas.
+ *
+ * @returns void
+ */
+void fill_leaf_tables() {
+  int order[LEAF_LEVELS];
+  for (int k = 0; k < LEAF_LEVELS; k++) {
+    order[k] = k;
+  }
+
+  for (int p = 0; p < LEAF_PERMUTATIONS; p++) {
+    memcpy(leaf_permutations[p], order, sizeof(order));
+    int from = LEAF_LEVELS;
+    for (int k = 0; k <= LEAF_LEVELS; k++) {
+      int to = (k < LEAF_LEVELS) ? order[k] : LEAF_LEVELS;
+      leaf_edges[k][p] = (from * (LEAF_LEVELS + 1)) + to;
+      from = to;
+    }
+
+    // Próxima permutação em ordem lexicográfica
+    int i = LEAF_LEVELS - 2;
+    while (i >= 0 && order[i] > order[i + 1]) {
+      i--;
+    }
+    if (i < 0) {
+      break;
+    }
+    int j = LEAF_LEVELS - 1;
+    while (order[j] < order[i]) {
+      j--;
+    }
+    int node = order[i];
+    order[i] = order[j];
+    order[j] = node;
+    for (int a = i + 1, b = LEAF_LEVELS - 1; a < b; a++, b--) {
+      node = order[a];
+      order[a] = order[b];
+      order[b] = node;
+    }
+  }
+}
+
+/**
+ * Calcula o custo de cada ordem dos nós dos níveis finais, sem instruções
+ * vetoriais
+ *
+ * @param edges a matriz de custos dos níveis finais (veja search_leaves)
+ * @param minimum onde é escrito o menor custo
+ *
+ * @returns a máscara das ordens com o menor custo
+ */
+unsigned int evaluate_leaves_scalar(const int *edges, int *minimum) {
+  int costs[LEAF_PERMUTATIONS];
+  *minimum = INT_MAX;
+  for (int p = 0; p < LEAF_PERMUTATIONS; p++) {
+    costs[p] = 0;
+    for (int k = 0; k <= LEAF_LEVELS; k++) {
+      costs[p] += edges[leaf_edges[k][p]];
+    }
+    if (costs[p] < *minimum) {
+      *minimum = costs[p];
+    }
+  }
+
+  unsigned int ties = 0;
+  for (int p = 0; p < LEAF_PERMUTATIONS; p++) {
+    ties |= (unsigned int)(costs[p] == *minimum) << p;
+  }
+  return ties;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/**
+ * Calcula o custo de cada ordem dos nós dos níveis finais com SSE4.1, quatro
+ * ordens por vez
+ *
+ * @param edges a matriz de custos dos níveis finais (veja search_leaves)
+ * @param minimum onde é escrito o menor custo
+ *
+ * @returns a máscara das ordens com o menor custo
+ */
+__attribute__((target("sse4.1"))) unsigned int
+evaluate_leaves_sse(const int *edges, int *minimum) {
+  __m128i costs[LEAF_PERMUTATIONS / 4];
+  __m128i best = _mm_set1_epi32(INT_MAX);
+  for (int v = 0; v < LEAF_PERMUTATIONS / 4; v++) {
+    costs[v] = _mm_setzero_si128();
+    for (int k = 0; k <= LEAF_LEVELS; k++) {
+      const int *index = &leaf_edges[k][v * 4];
+      costs[v] = _mm_add_epi32(
+          costs[v], _mm_setr_epi32(edges[index[0]], edges[index[1]],
+                                   edges[index[2]], edges[index[3]]));
+    }
+    best = _mm_min_epi32(best, costs[v]);
+  }
+
+  // O mínimo entre as quatro posições, repetido em todas elas
+  best = _mm_min_epi32(best, _mm_shuffle_epi32(best, _MM_SHUFFLE(1, 0, 3, 2)));
+  best = _mm_min_epi32(best, _mm_shuffle_epi32(best, _MM_SHUFFLE(2, 3, 0, 1)));
+  *minimum = _mm_cvtsi128_si32(best);
+
+  unsigned int ties = 0;
+  for (int v = 0; v < LEAF_PERMUTATIONS / 4; v++) {
+    __m128i equal = _mm_cmpeq_epi32(costs[v], best);
+    ties |= (unsigned int)_mm_movemask_ps(_mm_castsi128_ps(equal)) << (v * 4);
+  }
+  return ties;
+}
+
+/**
+ * Calcula o custo de cada ordem dos nós dos níveis finais com AVX2, oito
+ * ordens por vez, lendo as arestas de edges com gather
+ *
+ * @param edges a matriz de custos dos níveis finais (veja search_leaves)
+ * @param minimum onde é escrito o menor custo
+ *
+ * @returns a máscara das ordens com o menor custo
+ */
+__attribute__((target("avx2"))) unsigned int
+evaluate_leaves_avx2(const int *edges, int *minimum) {
+  __m256i costs[LEAF_PERMUTATIONS / 8];
+  __m256i best = _mm256_set1_epi32(INT_MAX);
+  for (int v = 0; v < LEAF_PERMUTATIONS / 8; v++) {
+    costs[v] = _mm256_setzero_si256();
+    for (int k = 0; k <= LEAF_LEVELS; k++) {
+      __m256i index = _mm256_load_si256((const __m256i *)&leaf_edges[k][v * 8]);
+      costs[v] =
+          _mm256_add_epi32(costs[v], _mm256_i32gather_epi32(edges, index, 4));
+    }
+    best = _mm256_min_epi32(best, costs[v]);
+  }
+
+  // O mínimo entre as oito posições, repetido em todas elas
+  best = _mm256_min_epi32(best, _mm256_permute2x128_si256(best, best, 1));
+  best = _mm256_min_epi32(best,
+                          _mm256_shuffle_epi32(best, _MM_SHUFFLE(1, 0, 3, 2)));
+  best = _mm256_min_epi32(best,
+                          _mm256_shuffle_epi32(best, _MM_SHUFFLE(2, 3, 0, 1)));
+  *minimum = _mm256_cvtsi256_si32(best);
+
+  unsigned int ties = 0;
+  for (int v = 0; v < LEAF_PERMUTATIONS / 8; v++) {
+    __m256i equal = _mm256_cmpeq_epi32(costs[v], best);
+    ties |= (unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(equal))
+            << (v * 8);
+  }
+  return ties;
+}
+#endif
+
+// A implementação de evaluate_leaves escolhida por select_leaf_kernel
+leaf_kernel evaluate_leaves = evaluate_leaves_scalar;
+
+/**
+ * Preenche as tabelas das folhas e escolhe a implementação de
+ * evaluate_leaves com as instruções vetoriais suportadas pelo processador,
+ * consultadas com CPUID
+ *
+ * @returns void
+ */
+void select_leaf_kernel() {
+  fill_leaf_tables();
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    evaluate_leaves = evaluate_leaves_avx2;
+  } else if (__builtin_cpu_supports("sse4.1")) {
+    evaluate_leaves = evaluate_leaves_sse;
+  }
+#endif
+}
+
+/*
+********* Funções do problema principal *********
+*/
+
+/**
+ * Gera uma matriz de custos para o grafo
+ *
+ * @param n o número de vértices do grafo
+ *
+ * @returns a matriz de custos das arestas
+ */
+cost_matrix *get_cost_matrix(int n) {
+  cost_matrix *matrix = new_matrix(n);
+  for (int i = 0; i < n; i++) {
+    weight *row = MATRIX_ROW(matrix, i);
+    for (int j = 0; j < n; j++) {
+      row[j] = rand() % (MAX_COST + 1);
+    }
+    row[i] = 0;
+  }
+
+  return matrix;
+}
+
+/**
+ * Cria a máscara dos nós ainda não visitados de uma busca, com todos os nós
+ * do grafo exceto os de initial, alocada na arena da thread
+ *
+ * @param n o número de nós no grafo
+ * @param initial os nós já visitados
+ * @param size o número de nós em initial
+ *
+ * @returns a máscara, com SET_WORDS(n) palavras
+ */
+unsigned long long *new_unvisited_set(int n, int *initial, int size) {
+  unsigned long long *set = (unsigned long long *)arena_alloc(
+      path_arena, SET_WORDS(n) * sizeof(unsigned long long));
+  for (int w = 0; w < SET_WORDS(n); w++) {
+    int bits = n - (w * SET_WORD_BITS);
+    set[w] = (bits >= SET_WORD_BITS) ? ~0ull : (1ull << bits) - 1;
+  }
+
+  for (int i = 0; i < size; i++) {
+    set[initial[i] / SET_WORD_BITS] &= ~(1ull << (initial[i] % SET_WORD_BITS));
+  }
+
+  return set;
+}
+
+/**
+ * Libera a máscara criada por new_unvisited_set
+ *
+ * @param set a máscara
+ * @param n o número de nós no grafo
+ *
+ * @returns void
+ */
+void delete_unvisited_set(unsigned long long *set, int n) {
+  arena_free(path_arena, set, SET_WORDS(n) * sizeof(unsigned long long));
+}
+
+/**
+ * Registra um caminho completo encontrado pela busca. Se ele for mais barato
+ * que os caminhos encontrados até então, eles são descartados.
+ *
+ * @param s o estado da busca, com o caminho completo em s->current
+ * @param cost o custo do caminho completo
+ *
+ * @returns void
+ */
+void record_search_path(search *s, int cost) {
+  if (s->res->count > 0 && cost == s->res->cost) {
+    COUNT_SEARCH(s, COUNTER_TIES);
+  }
+  add_to_path_list(s->res, s->current, cost);
 
-      /* somente seguir com a geração da path list
-      a partir de um nó não visitado */
-      if (!visited[i]) {
-        path *p = copy_path(initial_path);
-        concatenate_to_path(p, i);
+  if (s->best_cost != NULL && cost < *s->best_cost) {
+    *s->best_cost = cost;
+  }
+}
 
-        pll[i] = solve_problem(n, adj, p);
-        delete_path(p);
-      } else {
-        pll[i] = new_path_list(); //É uma path list vazia
+#ifdef SEARCH_STATS
+/**
+ * Conta os ramos dos níveis finais avaliados por search_leaves como a busca
+ * em profundidade os contaria, com a poda pelo melhor custo conhecido no
+ * início da avaliação. Só é compilada com os contadores da busca.
+ *
+ * @param s o estado da busca
+ * @param edges a matriz de custos dos níveis finais (veja search_leaves)
+ * @param from a linha de edges do último nó do caminho
+ * @param visited a máscara dos nós restantes já visitados
+ * @param cost o custo do caminho até from
+ *
+ * @returns void
+ */
+void count_leaf_search(search *s, const int *edges, int from,
+                       unsigned int visited, int cost) {
+  const int *row = edges + (from * (LEAF_LEVELS + 1));
+  if (visited == (1u << LEAF_LEVELS) - 1) {
+    COUNT_SEARCH(s, COUNTER_LEAVES);
+    if (row[LEAF_LEVELS] == LEAF_MISSING) {
+      COUNT_SEARCH(s, COUNTER_INFEASIBLE);
+    }
+    return;
+  }
+
+  for (int j = 0; j < LEAF_LEVELS; j++) {
+    if (visited & (1u << j)) {
+      continue;
+    } else if (row[j] == LEAF_MISSING) {
+      COUNT_SEARCH(s, COUNTER_INFEASIBLE);
+    } else if (s->best_cost != NULL && cost + row[j] > *s->best_cost) {
+      COUNT_SEARCH(s, COUNTER_PRUNED);
+    } else {
+      COUNT_SEARCH(s, COUNTER_EXPANDED);
+      count_leaf_search(s, edges, j, visited | (1u << j), cost + row[j]);
+    }
+  }
+}
+#endif
+
+/**
+ * Avalia de uma só vez todos os ciclos que completam um caminho ao qual
+ * faltam exatamente LEAF_LEVELS nós. Os custos das arestas entre os nós
+ * restantes, o último nó e STARTING_NODE são copiados para uma pequena
+ * matriz, o custo de cada ordem dos nós restantes é somado com instruções
+ * vetoriais (veja select_leaf_kernel), e só as ordens de menor custo são
+ * registradas, na mesma ordem em que a busca em profundidade as encontraria.
+ * Como as demais seriam descartadas ao registrar as de menor custo, a
+ * resposta é a mesma.
+ *
+ * @param s o estado da busca
+ * @param size o número de nós no caminho
+ * @param nodes os LEAF_LEVELS nós restantes, em ordem crescente
+ * @param cost o custo do caminho
+ *
+ * @returns void
+ */
+void search_leaves(search *s, int size, int *nodes, int cost) {
+  path *p = s->current;
+  _Alignas(32) int edges[(LEAF_LEVELS + 1) * (LEAF_LEVELS + 1)];
+  for (int i = 0; i <= LEAF_LEVELS; i++) {
+    weight *row =
+        MATRIX_ROW(s->adj, (i < LEAF_LEVELS) ? nodes[i] : p->nodes[size - 1]);
+    for (int j = 0; j <= LEAF_LEVELS; j++) {
+      int edge = row[(j < LEAF_LEVELS) ? nodes[j] : STARTING_NODE];
+      edges[(i * (LEAF_LEVELS + 1)) + j] =
+          (edge == MAX_COST) ? LEAF_MISSING : edge;
+    }
+  }
+
+  int minimum;
+  unsigned int ties = evaluate_leaves(edges, &minimum);
+#ifdef SEARCH_STATS
+  count_leaf_search(s, edges, LEAF_LEVELS, 0, cost);
+#endif
+  if (minimum >= LEAF_MISSING ||
+      (s->best_cost != NULL && cost + minimum > *s->best_cost)) {
+    return;
+  }
+
+  int current_size = p->size;
+  for (; ties != 0; ties &= ties - 1) {
+    int *order = leaf_permutations[__builtin_ctz(ties)];
+    for (int k = 0; k < LEAF_LEVELS; k++) {
+      p->nodes[size + k] = nodes[order[k]];
+    }
+    p->nodes[size + LEAF_LEVELS] = STARTING_NODE;
+    p->size = size + LEAF_LEVELS + 1;
+    record_search_path(s, cost + minimum);
+  }
+  p->size = current_size;
+}
+
+// Os kernels especializados, definidos abaixo de search_path
+extern search_kernel search_kernels[SPECIALIZED_MAX_SIZE + 1];
+
+/**
+ * Busca em profundidade a partir de s->current. Os nós são empilhados e
+ * desempilhados no próprio caminho, e os nós visitados são mantidos em
+ * uma máscara de bits. O custo do caminho é atualizado a cada aresta
+ * adicionada, e arestas inexistentes são descartadas assim que encontradas.
+ *
+ * @param s o estado da busca
+ * @param cost o custo de s->current
+ *
+ * @returns void
+ */
+void search_path(search *s, int cost) {
+  path *p = s->current;
+  weight *row = MATRIX_ROW(s->adj, p->nodes[p->size - 1]);
+
+  /* Com o limitante inferior, os últimos níveis, onde ele não é calculado,
+  ficam com o kernel especializado */
+  if (s->bound != NULL && s->n >= 1 && s->n <= SPECIALIZED_MAX_SIZE &&
+      s->n - p->size < BOUND_MIN_REMAINING) {
+    int size = p->size;
+    search_kernels[s->n](s, size, (unsigned int)s->unvisited[0], cost);
+    p->size = size;
+    return;
+  }
+
+  if (LEAF_SEARCH && s->n - p->size == LEAF_LEVELS) {
+    int nodes[LEAF_LEVELS], k = 0;
+    for (int w = 0; w < SET_WORDS(s->n); w++) {
+      for (unsigned long long set = s->unvisited[w]; set != 0; set &= set - 1) {
+        nodes[k++] = (w * SET_WORD_BITS) + __builtin_ctzll(set);
+      }
+    }
+    search_leaves(s, p->size, nodes, cost);
+    return;
+  }
+
+  if (p->size == s->n) { // Caso base da recursão
+    int edge = row[STARTING_NODE];
+    COUNT_SEARCH(s, COUNTER_LEAVES);
+    if (edge != MAX_COST) {
+      p->nodes[p->size++] = STARTING_NODE;
+      record_search_path(s, cost + edge);
+      p->size--;
+    } else {
+      COUNT_SEARCH(s, COUNTER_INFEASIBLE);
+    }
+    return;
+  }
+
+  for (int w = 0; w < SET_WORDS(s->n); w++) {
+    unsigned long long candidates = s->unvisited[w];
+    while (candidates != 0) {
+      int i = (w * SET_WORD_BITS) + __builtin_ctzll(candidates);
+      candidates &= candidates - 1;
+
+      int edge = row[i];
+      if (edge == MAX_COST) {
+        COUNT_SEARCH(s, COUNTER_INFEASIBLE);
+        continue;
       }
 
-      // Obtém o custo mínimo dos caminhos possíveis
-      int cost = get_path_list_paths_cost(pll[i], adj);
-      if (cost != PATH_LIST_EMPTY && cost < min_cost) {
-        min_cost = cost;
+      /* poda os ramos cujo custo parcial já é maior que o melhor custo
+      conhecido. A comparação é estrita para manter todos os empates */
+      if (s->best_cost != NULL && cost + edge > *s->best_cost) {
+        COUNT_SEARCH(s, COUNTER_PRUNED);
+        continue;
       }
+
+      p->nodes[p->size++] = i;
+      s->unvisited[w] &= ~(1ull << (i % SET_WORD_BITS));
+      if (s->bound != NULL && exceeds_lower_bound(s, cost + edge)) {
+        COUNT_SEARCH(s, COUNTER_PRUNED);
+      } else {
+        COUNT_SEARCH(s, COUNTER_EXPANDED);
+        search_path(s, cost + edge);
+      }
+      s->unvisited[w] |= 1ull << (i % SET_WORD_BITS);
+      p->size--;
+    }
+  }
+}
+
+/**
+ * Define search_path_N, uma versão de search_path especializada para grafos
+ * de exatamente N nós. Com N conhecido em tempo de compilação, o laço sobre os
+ * candidatos é desenrolado por completo e a máscara dos nós não visitados é
+ * passada por valor, podendo ficar em um registrador.
+ *
+ * @param N o número de nós no grafo
+ */
+#define DEFINE_SEARCH_KERNEL(N)                                                \
+  void search_path_##N(search *s, int size, unsigned int unvisited,            \
+                       int cost) {                                             \
+    path *p = s->current;                                                      \
+    weight *row = MATRIX_ROW(s->adj, p->nodes[size - 1]);                      \
+                                                                               \
+    if (size == N) {                                                           \
+      int edge = row[STARTING_NODE];                                           \
+      COUNT_SEARCH(s, COUNTER_LEAVES);                                         \
+      if (edge != MAX_COST) {                                                  \
+        p->nodes[N] = STARTING_NODE;                                           \
+        p->size = N + 1;                                                       \
+        record_search_path(s, cost + edge);                                    \
+      } else {                                                                 \
+        COUNT_SEARCH(s, COUNTER_INFEASIBLE);                                   \
+      }                                                                        \
+      return;                                                                  \
+    }                                                                          \
+                                                                               \
+    if (LEAF_SEARCH && N - size == LEAF_LEVELS) {                              \
+      int nodes[LEAF_LEVELS];                                                  \
+      unsigned int set = unvisited;                                            \
+      for (int k = 0; k < LEAF_LEVELS; k++, set &= set - 1) {                  \
+        nodes[k] = __builtin_ctz(set);                                         \
+      }                                                                        \
+      search_leaves(s, size, nodes, cost);                                     \
+      return;                                                                  \
+    }                                                                          \
+                                                                               \
+    _Pragma("GCC unroll 16") for (int i = 0; i < N; i++) {                     \
+      int edge = row[i];                                                       \
+      if (!(unvisited & (1u << i))) {                                          \
+        continue;                                                              \
+      } else if (edge == MAX_COST) {                                           \
+        COUNT_SEARCH(s, COUNTER_INFEASIBLE);                                   \
+        continue;                                                              \
+      } else if (s->best_cost != NULL && cost + edge > *s->best_cost) {        \
+        COUNT_SEARCH(s, COUNTER_PRUNED);                                       \
+        continue;                                                              \
+      }                                                                        \
+                                                                               \
+      COUNT_SEARCH(s, COUNTER_EXPANDED);                                       \
+      p->nodes[size] = i;                                                      \
+      search_path_##N(s, size + 1, unvisited & ~(1u << i), cost + edge);       \
+    }                                                                          \
+  }
+
+DEFINE_SEARCH_KERNEL(1)
+DEFINE_SEARCH_KERNEL(2)
+DEFINE_SEARCH_KERNEL(3)
+DEFINE_SEARCH_KERNEL(4)
+DEFINE_SEARCH_KERNEL(5)
+DEFINE_SEARCH_KERNEL(6)
+DEFINE_SEARCH_KERNEL(7)
+DEFINE_SEARCH_KERNEL(8)
+DEFINE_SEARCH_KERNEL(9)
+DEFINE_SEARCH_KERNEL(10)
+DEFINE_SEARCH_KERNEL(11)
+DEFINE_SEARCH_KERNEL(12)
+DEFINE_SEARCH_KERNEL(13)
+DEFINE_SEARCH_KERNEL(14)
+DEFINE_SEARCH_KERNEL(15)
+DEFINE_SEARCH_KERNEL(16)
+
+// Os kernels especializados, indexados pelo número de nós do grafo
+search_kernel search_kernels[SPECIALIZED_MAX_SIZE + 1] = {
+    NULL,             search_path_1,  search_path_2,  search_path_3,
+    search_path_4,    search_path_5,  search_path_6,  search_path_7,
+    search_path_8,    search_path_9,  search_path_10, search_path_11,
+    search_path_12,   search_path_13, search_path_14, search_path_15,
+    search_path_16};
+
+/**
+ * Busca em profundidade a partir de s->current, com o kernel especializado
+ * para s->n se houver um, ou com search_path caso contrário. Com o limitante
+ * inferior, a busca começa por search_path, que o calcula.
+ *
+ * @param s o estado da busca
+ * @param cost o custo de s->current
+ *
+ * @returns void
+ */
+void start_search(search *s, int cost) {
+  if (s->bound == NULL && s->n >= 1 && s->n <= SPECIALIZED_MAX_SIZE) {
+    search_kernels[s->n](s, s->current->size, (unsigned int)s->unvisited[0],
+                         cost);
+  } else {
+    search_path(s, cost);
+  }
+}
+
+/**
+ * Resolve o problema para um dado n, uma lista de adjacências e o caminho
+ * inicial. Esse algoritmo é uma busca em profundidade, que trabalha sobre
+ * uma única cópia do caminho inicial.
+ *
+ * @param n o número de nós no grafo
+ * @param adj a lista de adjacências do grafo, com os pesos
+ * @param initial_path o caminho inicial, que não é modificado
+ * @param best_cost o custo do melhor caminho conhecido até então, atualizado
+ * pela função. Ramos cujo custo parcial ou limitante inferior já o
+ * ultrapassam não são explorados. Se for NULL, a busca é exaustiva (sem poda).
+ * @param res a path list onde são registrados os caminhos de menor custo
+ *
+ * @returns void
+ */
+void solve_problem(int n, cost_matrix *adj, path *initial_path,
+                   int *best_cost, path_list *res) {
+  search s;
+  s.n = n;
+  s.adj = adj;
+  s.current = copy_path(initial_path);
+  s.best_cost = best_cost;
+  s.res = res;
+  s.counters = search_counters;
+  s.bound = (best_cost != NULL) ? new_lower_bound(adj) : NULL;
+
+  s.unvisited = new_unvisited_set(n, initial_path->nodes, initial_path->size);
+
+  s.current->cost = COST_NOT_COMPUTED;
+  int cost = get_path_cost(s.current, adj);
+  if (cost != COST_INFINITE) {
+    start_search(&s, cost);
+  }
+
+  if (s.bound != NULL) {
+    delete_lower_bound(s.bound);
+  }
+  delete_unvisited_set(s.unvisited, n);
+  delete_path(s.current);
+}
+
+/**
+ * Obtém o nó do grafo correspondente ao bit j das máscaras do Held-Karp.
+ * As máscaras representam apenas os nós diferentes de STARTING_NODE.
+ *
+ * @param j o índice do bit
+ *
+ * @returns o nó correspondente
+ */
+int held_karp_node(int j) { return (j < STARTING_NODE) ? j : j + 1; }
+
+/**
+ * Reconstrói, a partir da tabela do Held-Karp, todos os caminhos ótimos que
+ * terminam no estado (mask, j), preenchendo p de trás para frente.
+ *
+ * @param dp a tabela do Held-Karp
+ * @param m o número de bits das máscaras (n - 1)
+ * @param adj a matriz de adjacências do grafo
+ * @param mask o conjunto de nós visitados no estado
+ * @param j o bit do último nó visitado no estado
+ * @param p o caminho sendo reconstruído
+ * @param position a posição de p que recebe o nó do bit j
+ * @param res a path list onde são registrados os caminhos reconstruídos
+ *
+ * @returns void
+ */
+void held_karp_collect(int *dp, int m, cost_matrix *adj, unsigned int mask, int j,
+                       path *p, int position, path_list *res) {
+  int node = held_karp_node(j);
+  p->nodes[position] = node;
+
+  unsigned int previous = mask & ~(1u << j);
+  if (previous == 0) { // Chegou no primeiro nó após STARTING_NODE
+    add_to_path_list(res, p, p->cost);
+    return;
+  }
+
+  int cost = dp[(size_t)mask * m + j];
+  for (int k = 0; k < m; k++) {
+    if (!(previous & (1u << k))) {
+      continue;
+    }
+
+    int edge = EDGE_COST(adj, held_karp_node(k), node);
+    int previous_cost = dp[(size_t)previous * m + k];
+    if (edge != MAX_COST && previous_cost != COST_INFINITE &&
+        previous_cost + edge == cost) {
+      held_karp_collect(dp, m, adj, previous, k, p, position - 1, res);
     }
+  }
+}
+
+/**
+ * Resolve o problema para um dado n e uma lista de adjacências com o algoritmo
+ * de programação dinâmica de Held-Karp, em O(n² * 2^n). A tabela é um único
+ * vetor indexado por (conjunto de nós visitados, último nó visitado), em que
+ * as entradas de um mesmo conjunto são contíguas.
+ *
+ * @param n o número de nós no grafo
+ * @param adj a lista de adjacências do grafo, com os pesos
+ * @param res a path list onde são registrados os caminhos de menor custo
+ *
+ * @returns 0, ou 1 caso não haja memória suficiente para a tabela
+ */
+int solve_problem_held_karp(int n, cost_matrix *adj, path_list *res) {
+  path *p = new_path();
+  p->size = n + 1;
+  p->nodes[0] = STARTING_NODE;
+  p->nodes[n] = STARTING_NODE;
 
-    path_list *res = new_path_list(); // A path list que armazena a resposta
+  if (n == 0) { // Não há nenhum caminho
+    delete_path(p);
+    return 0;
+  }
 
-    for (int i = 0; i < n; i++) {
-      if (get_path_list_paths_cost(pll[i], adj) == min_cost) {
-        merge_path_lists(res, pll[i]);
+  if (n == 1) { // Só há o caminho trivial
+    add_to_path_list(res, p, get_path_cost(p, adj));
+    delete_path(p);
+    return 0;
+  }
+
+  int m = n - 1;
+  unsigned int full = (1u << m) - 1;
+  int *dp = (int *)malloc(((size_t)full + 1) * m * sizeof(int));
+  if (dp == NULL) {
+    delete_path(p);
+    return 1;
+  }
+
+  for (unsigned int mask = 1; mask <= full; mask++) {
+    int *row = dp + (size_t)mask * m;
+
+    for (int j = 0; j < m; j++) {
+      row[j] = COST_INFINITE;
+      if (!(mask & (1u << j))) {
+        continue;
+      }
+
+      int node = held_karp_node(j);
+      unsigned int previous = mask & ~(1u << j);
+      if (previous == 0) { // Caso base: STARTING_NODE -> node
+        if (EDGE_COST(adj, STARTING_NODE, node) != MAX_COST) {
+          row[j] = EDGE_COST(adj, STARTING_NODE, node);
+        }
+        continue;
       }
 
-      delete_path_list_paths(pll[i]);
-      delete_path_list(pll[i]);
+      // Todas as entradas de previous estão contíguas na tabela
+      int *previous_row = dp + (size_t)previous * m;
+      for (int k = 0; k < m; k++) {
+        int edge = EDGE_COST(adj, held_karp_node(k), node);
+        if (previous_row[k] == COST_INFINITE || edge == MAX_COST ||
+            !(previous & (1u << k))) {
+          continue;
+        }
+
+        if (previous_row[k] + edge < row[j]) {
+          row[j] = previous_row[k] + edge;
+        }
+      }
     }
+  }
 
-    free(pll);
+  // Fecha o ciclo de volta para STARTING_NODE
+  int *last_row = dp + (size_t)full * m;
+  int min_cost = COST_INFINITE;
+  for (int j = 0; j < m; j++) {
+    int edge = EDGE_COST(adj, held_karp_node(j), STARTING_NODE);
+    if (last_row[j] != COST_INFINITE && edge != MAX_COST &&
+        last_row[j] + edge < min_cost) {
+      min_cost = last_row[j] + edge;
+    }
+  }
 
-    return res;
+  if (min_cost != COST_INFINITE) {
+    p->cost = min_cost;
+    for (int j = 0; j < m; j++) {
+      int edge = EDGE_COST(adj, held_karp_node(j), STARTING_NODE);
+      if (last_row[j] != COST_INFINITE && edge != MAX_COST &&
+          last_row[j] + edge == min_cost) {
+        held_karp_collect(dp, m, adj, full, j, p, n - 1, res);
+      }
+    }
   }
+
+  free(dp);
+  delete_path(p);
+
+  return 0;
 }
 
 /**
- * Imprime a resposta
+ * Imprime a resposta, de acordo com o modo de saída
  *
+ * @param stream o arquivo onde a resposta é impressa
  * @param pl a path list da solução
  * @param adj a matriz de adjacências do grafo
- * @param n a ordem do grafo do problema
+ * @param opts as opções de execução
  *
  * @returns void
  */
-void print_answer(path_list *pl, int **adj, int n) {
-  int cost = get_path_list_paths_cost(pl, adj);
+void print_answer(FILE *stream, path_list *pl, cost_matrix *adj,
+                  options *opts) {
+  int cost = get_path_list_paths_cost(pl);
 
-  printf("Matriz de adjacências: \n");
-  print_matrix(adj, n, n);
+  fprintf(stream, "Matriz de adjacências: \n");
+  print_matrix(stream, adj);
 
   if (cost == PATH_LIST_EMPTY) {
-    printf("Nenhum caminho pôde ser encontrado\n");
+    fprintf(stream, "Nenhum caminho pôde ser encontrado\n");
+    return;
+  }
+
+  if (opts->output == OUTPUT_COUNT) {
+    fprintf(stream, "\n%lld caminhos encontrados, com custo %d\n", pl->count,
+            cost);
+    return;
+  }
+
+  if (opts->output == OUTPUT_STREAM) {
+    fprintf(stream,
+            "\n%lld caminhos encontrados, com custo %d, escritos em %s\n",
+            pl->count, cost, opts->output_file);
     return;
   }
 
-  printf("\nCaminhos encontrados, com custo %d: \n", cost);
+  if (opts->output == OUTPUT_FIRST) {
+    fprintf(stream, "\n%lld caminhos encontrados, com custo %d. Um deles: \n",
+            pl->count, cost);
+  } else {
+    fprintf(stream, "\nCaminhos encontrados, com custo %d: \n", cost);
+  }
+
   for (int i = 0; i < pl->size; i++) {
     path *p = pl->paths[i];
 
-    print_path(p);
+    print_path(stream, p);
   }
 }
 
-int main(int argc, char **argv) {
-  if (argc < 2) {
-    printf("O número de cidades não foi especificado. Execute o programa com "
-           "\"./pcv N\", onde N é o número de cidades.\n");
-    return 1;
-  }
-
-  int n = atoi(argv[1]);
+/**
+ * Resolve uma instância do problema e imprime a resposta
+ *
+ * @param costs a matriz de custos da instância
+ * @param opts as opções de execução
+ * @param stream o arquivo onde os caminhos são escritos no modo OUTPUT_STREAM,
+ * ou NULL
+ *
+ * @returns 0 em caso de sucesso, 1 em caso de erro
+ */
+int solve_instance(cost_matrix *costs, options *opts, FILE *stream) {
+  int n = costs->n;
 
-  if (n + 1 > MAX_GRAPH_SIZE) {
-    printf("O N passado é maior que o limite do programa. Isso pode ser "
-           "resolvido se modificando o macro MAX_GRAPH_SIZE, na linha 24, e "
-           "recompilando o programa. \n");
+  if (opts->solver == SOLVER_HELD_KARP && n > HELD_KARP_MAX_SIZE) {
+    printf("O Held-Karp suporta grafos de até %d cidades.\n",
+           HELD_KARP_MAX_SIZE);
     return 1;
   }
 
-  int seed = time(0);
-  srand(seed);
+  max_path_size = n + 1;
 
-  int **costs = get_cost_matrix(n);
   path *initial_path = new_path();
   concatenate_to_path(initial_path, STARTING_NODE);
 
-  path_list *res = solve_problem(n, costs, initial_path);
-  print_answer(res, costs, n);
+  path_list *res = new_path_list();
+  set_path_list_output(res, opts->output, stream);
+
+  int return_value = 0;
+  double start = get_time();
+  if (opts->solver == SOLVER_HELD_KARP) {
+    if (solve_problem_held_karp(n, costs, res)) {
+      printf("Não há memória suficiente para a tabela do Held-Karp com N = "
+             "%d.\n",
+             n);
+      return_value = 1;
+    }
+  } else {
+    int best_cost = opts->branch_and_bound ? get_warm_start_cost(costs, 0, 1)
+                                           : COST_INFINITE;
+    solve_problem(n, costs, initial_path,
+                  opts->branch_and_bound ? &best_cost : NULL, res);
+  }
+
+  phase_times[PHASE_SEARCH] += get_time() - start;
+
+  if (return_value == 0) {
+    start = get_time();
+    print_answer(stdout, res, costs, opts);
+    phase_times[PHASE_OUTPUT] += get_time() - start;
+  }
 
   delete_path(initial_path);
   delete_path_list_paths(res);
   delete_path_list(res);
-  delete_matrix(costs, n);
+
+  return return_value;
+}
+
+/*
+************* Utilidades para lotes *************
+*/
+
+/**
+ * Lê a próxima instância de uma lista de instâncias. Cada linha da lista é
+ * uma instância (veja get_batch_matrix). Linhas vazias e linhas que começam
+ * com '#' são ignoradas.
+ *
+ * @param list a lista de instâncias
+ * @param name onde a linha da instância é escrita, sem a quebra de linha, com
+ * até BATCH_MAX_LINE caracteres
+ *
+ * @returns 1 se uma instância foi lida, 0 se a lista terminou
+ */
+int read_batch_instance(FILE *list, char *name) {
+  while (fgets(name, BATCH_MAX_LINE, list) != NULL) {
+    name[strcspn(name, "\r\n")] = '\0';
+    if (name[0] != '\0' && name[0] != '#') {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * Obtém a matriz de uma instância de uma lista de instâncias, que pode ser
+ * um número de cidades, para uma matriz gerada aleatoriamente, ou o nome de
+ * um arquivo de matriz (veja read_cost_matrix)
+ *
+ * @param name a linha da instância
+ *
+ * @returns a matriz da instância, ou NULL se ela não pôde ser lida
+ */
+cost_matrix *get_batch_matrix(char *name) {
+  if (strspn(name, "0123456789") == strlen(name) && atoi(name) > 0) {
+    return get_cost_matrix(atoi(name));
+  }
+
+  return read_cost_matrix(name);
+}
+
+/**
+ * Resolve as instâncias de uma lista, uma de cada vez, imprimindo as
+ * respostas na ordem da lista. O custo de iniciar o programa é pago uma
+ * única vez para todas as instâncias.
+ *
+ * @param list a lista de instâncias
+ * @param opts as opções de execução
+ *
+ * @returns 0 se todas as instâncias foram resolvidas, 1 caso contrário
+ */
+int solve_batch(FILE *list, options *opts) {
+  char name[BATCH_MAX_LINE];
+  int return_value = 0;
+
+  for (int index = 0; read_batch_instance(list, name); index++) {
+    printf("%sInstância %d: %s\n", (index > 0) ? "\n" : "", index, name);
+    cost_matrix *costs = get_batch_matrix(name);
+    if (costs == NULL) {
+      printf("A matriz da instância não pôde ser lida\n");
+      return_value = 1;
+      continue;
+    }
+
+    return_value |= solve_instance(costs, opts, NULL);
+    delete_matrix(costs);
+  }
+
+  return return_value;
+}
+
+/**
+ * Lê as opções de execução da linha de comando. O primeiro argumento é o
+ * número de cidades, que pode ser omitido quando a matriz é lida de um
+ * arquivo, seguido das flags opcionais:
+ *
+ * -i ARQUIVO: lê a matriz de custos de ARQUIVO (TSPLIB ou matriz binária), ao
+ * invés de gerá-la aleatoriamente. O número de cidades é o do arquivo.
+ * -l LISTA: resolve em lote as instâncias de LISTA ("-" para a entrada
+ * padrão), uma por linha, e imprime as respostas na ordem da lista
+ * -r SEMENTE: gera a matriz aleatória a partir de SEMENTE, ao invés do
+ * horário
+ * -t: imprime na saída de erro o tempo gasto em cada fase (veja
+ * print_phase_times)
+ * -e: imprime na saída de erro os contadores da busca, que devem ser
+ * habilitados na compilação com -DSEARCH_STATS
+ * -b: habilita a poda por branch and bound, pelo custo parcial e pelo
+ * limitantes inferiores (veja exceeds_lower_bound)
+ * -d: resolve o problema por programação dinâmica (Held-Karp), ao invés da
+ * busca em profundidade
+ * -c: imprime apenas o menor custo e o número de caminhos com esse custo
+ * -f: imprime apenas um dos caminhos de menor custo
+ * -w ARQUIVO: escreve os caminhos de menor custo em ARQUIVO à medida que são
+ * encontrados, sem guardá-los na memória
+ *
+ * @param argc o número de argumentos
+ * @param argv os argumentos
+ * @param opts as opções lidas
+ *
+ * @returns 0 se todas as opções são válidas, ou o índice em argv da primeira
+ * opção inválida
+ */
+int parse_options(int argc, char **argv, options *opts) {
+  opts->n = -1;
+  opts->branch_and_bound = 0;
+  opts->solver = SOLVER_DFS;
+  opts->output = OUTPUT_ALL;
+  opts->output_file = NULL;
+  opts->input_file = NULL;
+  opts->batch_file = NULL;
+  opts->seed = SEED_FROM_TIME;
+  opts->timing = 0;
+  opts->stats = 0;
+
+  int first = 1;
+  if (argc > 1 && argv[1][0] != '-') {
+    opts->n = atoi(argv[1]);
+    first = 2;
+  }
+
+  for (int i = first; i < argc; i++) {
+    if (strcmp(argv[i], "-b") == 0) {
+      opts->branch_and_bound = 1;
+    } else if (strcmp(argv[i], "-d") == 0) {
+      opts->solver = SOLVER_HELD_KARP;
+    } else if (strcmp(argv[i], "-c") == 0) {
+      opts->output = OUTPUT_COUNT;
+    } else if (strcmp(argv[i], "-f") == 0) {
+      opts->output = OUTPUT_FIRST;
+    } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+      opts->output = OUTPUT_STREAM;
+      opts->output_file = argv[++i];
+    } else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+      opts->input_file = argv[++i];
+    } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+      opts->batch_file = argv[++i];
+    } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc &&
+               argv[i + 1][0] >= '0' && argv[i + 1][0] <= '9') {
+      opts->seed = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-t") == 0) {
+      opts->timing = 1;
+    } else if (strcmp(argv[i], "-e") == 0) {
+      opts->stats = 1;
+    } else {
+      return i;
+    }
+  }
 
   return 0;
 }
+
+int main(int argc, char **argv) {
+  select_leaf_kernel();
+
+  options opts;
+  int invalid = parse_options(argc, argv, &opts);
+  if (invalid) {
+    printf("Opção desconhecida: %s\n", argv[invalid]);
+    return 1;
+  }
+
+  if (opts.n < 0 && opts.input_file == NULL && opts.batch_file == NULL) {
+    printf("O número de cidades não foi especificado. Execute o programa com "
+           "\"./pcv N [-b] [-d] [-c | -f | -w ARQUIVO]\", onde N é o número de "
+           "cidades, ou com \"./pcv -i ARQUIVO [...]\" para ler a matriz de "
+           "ARQUIVO, ou com \"./pcv -l LISTA [...]\" para resolver em lote as "
+           "instâncias de LISTA.\n");
+    return 1;
+  }
+
+  if (opts.batch_file != NULL &&
+      (opts.input_file != NULL || opts.output == OUTPUT_STREAM ||
+       opts.timing)) {
+    printf("A opção -l não pode ser usada com -i, -w ou -t.\n");
+    return 1;
+  }
+
+  if (opts.stats &&
+      (opts.solver == SOLVER_HELD_KARP || opts.batch_file != NULL)) {
+    printf("A opção -e não pode ser usada com -d ou -l.\n");
+    return 1;
+  }
+
+#ifndef SEARCH_STATS
+  if (opts.stats) {
+    printf("Os contadores da busca não foram habilitados na compilação. "
+           "Recompile o programa com DEFINES=-DSEARCH_STATS no make.\n");
+    return 1;
+  }
+#endif
+
+  int seed = (opts.seed != SEED_FROM_TIME) ? opts.seed : time(0);
+  srand(seed);
+
+  if (opts.batch_file != NULL) {
+    FILE *list = (strcmp(opts.batch_file, "-") == 0)
+                     ? stdin
+                     : fopen(opts.batch_file, "r");
+    if (list == NULL) {
+      printf("Não foi possível abrir o arquivo %s.\n", opts.batch_file);
+      return 1;
+    }
+
+    path_arena = new_arena();
+    int return_value = solve_batch(list, &opts);
+
+    if (list != stdin) {
+      fclose(list);
+    }
+    delete_arena(path_arena);
+
+    return return_value;
+  }
+
+  double start = get_time();
+  cost_matrix *costs = (opts.input_file != NULL)
+                           ? read_cost_matrix(opts.input_file)
+                           : get_cost_matrix(opts.n);
+  if (costs == NULL) {
+    return 1;
+  }
+  phase_times[PHASE_GENERATION] = get_time() - start;
+
+  FILE *stream = NULL;
+  if (opts.output == OUTPUT_STREAM) {
+    stream = fopen(opts.output_file, "w+");
+    if (stream == NULL) {
+      printf("Não foi possível abrir o arquivo %s.\n", opts.output_file);
+      delete_matrix(costs);
+      return 1;
+    }
+  }
+
+  path_arena = new_arena();
+  int return_value = solve_instance(costs, &opts, stream);
+
+  if (opts.timing && return_value == 0) {
+    print_phase_times(costs->n, seed, 1, 1);
+  }
+
+  if (opts.stats) {
+    print_search_counters();
+  }
+
+  if (stream != NULL) {
+    fclose(stream);
+  }
+  delete_matrix(costs);
+  delete_arena(path_arena);
+
+  return return_value;
+}